@@ -0,0 +1,175 @@
+//------------------------------------------------------------------------
+//
+// file:      bam.c
+//
+// purpose:   Bit angle modulation (dimming) of the 16 relay outputs
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at http://www.gnu.org/licenses/gpl.txt
+//
+//------------------------------------------------------------------------
+//
+// Each output has a level (0..255; CV696-CV711). An output that is switched on by relays.c
+// is only driven during the bit slices of its level: slice k lasts BAM_UNIT << k timer counts
+// and is active if bit k of the level is set. Level 255 is therefore always on, level 0 always
+// off. Lamps can be dimmed and relay coils can be held with a reduced current.
+//
+// Timer1 provides the slices via Output Compare A; it runs free (normal mode, 16 bits) and
+// only while an output is dimmed. The compare ISR does not depend on the number of outputs:
+// per slice it writes a precalculated gate pattern to each port. So a BAM period (about 7.4 ms
+// at 11.0592 MHz) costs BAM_BITS short interrupts. The shortest slices last only a few tens of
+// us; if the ISR starts so late (other interrupts) that the next compare value has already
+// passed, the ISR continues with the following slices until the compare lies ahead of TCNT1
+// again. Otherwise the compare would only match after Timer1 wrapped (up to 59 ms, output off).
+// If all levels are 255, Timer1 is stopped; it is then free for other use (the clock and the
+// software timers run on Timer2). Input capture is used by events.c for the program button
+// (ATmega8535/16/32): it works also while Timer1 is stopped, and the writes to TCCR1B here must
+// keep ICES1 0 (falling edge). Output Compare B is never used.
+//
+// Since the ISR writes PORTA and PORTC, all other writes to these ports should go via
+// bam_write_A() / bam_write_C(). OutA and OutC hold the outputs that are switched on.
+//
+//------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <avr/pgmspace.h>        // put var to program memory
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+#include <string.h>
+
+#include "config.h"              // general definitions the decoder, cv's
+#include "myeeprom.h"            // wrapper for eeprom
+#include "hardware.h"            // port definitions for target
+
+#include "bam.h"
+
+//--------------------------------------------------------------------------------------
+// Timer 1 specific settings
+#if defined ENHANCED_PROCESSOR
+  #define TC1_Interrupt_Mask_Register				TIMSK1				// Register
+  #define TC1_Interrupt_Flag_Register				TIFR1				// Register
+#else 
+  #define TC1_Interrupt_Mask_Register				TIMSK
+  #define TC1_Interrupt_Flag_Register				TIFR
+#endif
+
+#define BAM_BITS    8            // resolution of the levels
+#define BAM_UNIT    40           // length of the shortest slice in Timer1 counts (about 29 us
+                                 // with prescaler 8); BAM period = 255 * BAM_UNIT counts
+#define BAM_MARGIN  16           // a compare must lie at least this number of counts ahead of
+                                 // TCNT1 when the ISR leaves (exit of the ISR and a few cycles)
+
+//--------------------------------------------------------------------------------------
+// Global Data
+volatile unsigned char OutA;     // outputs of PORTA that are switched on
+volatile unsigned char OutC;     // same, but now for PORTC
+
+// local variables
+unsigned char BamGateA[BAM_BITS];   // per slice: outputs of PORTA that may be on
+unsigned char BamGateC[BAM_BITS];   // same, but now for PORTC
+volatile unsigned char BamBit;      // current slice
+unsigned char BamLevel[16];         // level per output (0 = relay 1, 15 = relay 16)
+
+
+//--------------------------------------------------------------------------------------
+ISR(TIMER1_COMPA_vect)
+{
+  unsigned char bit;
+  unsigned int next;
+  bit = BamBit;
+  next = OCR1A;
+  do {
+    bit++;
+    if (bit == BAM_BITS) {bit = 0;}
+    PORTA = OutA & BamGateA[bit];
+    PORTC = OutC & BamGateC[bit];
+    next = next + (BAM_UNIT << bit);            // from the previous compare: no drift
+  } while ((int16_t)(next - TCNT1) < BAM_MARGIN); // late: this slice is over, catch up
+  BamBit = bit;
+  OCR1A = next;                                 // (wraps with Timer1 at 0xFFFF)
+}
+
+
+//--------------------------------------------------------------------------------------
+void bam_write_A(unsigned char value)
+{
+  unsigned char sreg = SREG;
+  cli();
+  OutA = value;
+  PORTA = value & BamGateA[BamBit];
+  SREG = sreg;
+}
+
+void bam_write_C(unsigned char value)
+{
+  unsigned char sreg = SREG;
+  cli();
+  OutC = value;
+  PORTC = value & BamGateC[BamBit];
+  SREG = sreg;
+}
+
+
+void bam_set_level(unsigned char output, unsigned char level)
+{
+  // output: 0..15 (relay 1..16). Relays 9-16 are connected in reversed order to PORTA
+  unsigned char k, mask, dimmed, sreg;
+  if (output > 15) return;
+  BamLevel[output] = level;
+  if (output < 8) {mask = 1 << output;}
+  else {mask = 0b10000000 >> (output - 8);}
+  for (k=0; k < BAM_BITS; k++) {
+    if (output < 8) {
+      if (level & (1 << k)) {BamGateC[k] |= mask;} else {BamGateC[k] &= ~mask;}
+    }
+    else {
+      if (level & (1 << k)) {BamGateA[k] |= mask;} else {BamGateA[k] &= ~mask;}
+    }
+  }
+  dimmed = 0;
+  for (k=0; k < 16; k++) {if (BamLevel[k] != 0xFF) {dimmed = 1;}}
+  sreg = SREG;
+  cli();
+  if (dimmed) {
+    if ((TC1_Interrupt_Mask_Register & (1<<OCIE1A)) == 0) {
+      TCNT1 = 0;
+      OCR1A = BAM_UNIT;                         // first slice starts soon
+      BamBit = BAM_BITS - 1;
+      TC1_Interrupt_Flag_Register = (1<<OCF1A); // clear an old compare match
+      TC1_Interrupt_Mask_Register |= (1<<OCIE1A);
+      TCCR1B = (1<<CS11);                       // start Timer1: normal mode, prescaler 8
+    }
+  }
+  else {
+    TCCR1B = 0;                                 // stop Timer1
+    TC1_Interrupt_Mask_Register &= ~(1<<OCIE1A);
+    BamBit = 0;                                 // gates of all slices are 0xFF now
+    PORTA = OutA;
+    PORTC = OutC;
+  }
+  SREG = sreg;
+}
+
+
+void bam_read_cvs(void)
+{
+  unsigned char i;
+  for (i=0; i < 16; i++) {bam_set_level(i, my_eeprom_read_byte(&CV.RLevel[i]));}
+}
+
+
+void init_bam(void)
+{
+  unsigned char k;
+  TCCR1B = 0;                                   // Timer1 stopped, normal mode
+  TCCR1A = 0;
+  for (k=0; k < BAM_BITS; k++) {BamGateA[k] = 0xFF; BamGateC[k] = 0xFF;}
+  for (k=0; k < 16; k++) {BamLevel[k] = 0xFF;}
+  BamBit = 0;
+  OutA = PORTA;
+  OutC = PORTC;
+  bam_read_cvs();
+}
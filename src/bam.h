@@ -0,0 +1,19 @@
+//------------------------------------------------------------------------
+//
+// file:      bam.h
+//
+// purpose:   Bit angle modulation (dimming) of the 16 relay outputs
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at http://www.gnu.org/licenses/gpl.txt
+//
+//------------------------------------------------------------------------
+// Global Data: 
+extern volatile unsigned char OutA;          // Outputs of PORTA that are switched on
+extern volatile unsigned char OutC;          // Outputs of PORTC that are switched on
+
+void init_bam(void);                         // sets up Timer1
+void bam_read_cvs(void);                     // (re)reads the levels (CV696-CV711)
+void bam_write_A(unsigned char value);       // switches the outputs of PORTA
+void bam_write_C(unsigned char value);       // switches the outputs of PORTC
+void bam_set_level(unsigned char output, unsigned char level); // output 0..15, level 0..255
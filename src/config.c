@@ -56,23 +56,9 @@
                                  // 2: test timing engine
                                  // 3: test action
 
-//----------------------------------------------------------------------------
-// Timing Definitions:
-// (note: every timing is given in us)
-
-#define TICK_PERIOD 20000L       // 20ms tick for Timing Engine
-                                 // => possible values for timings up to
-                                 //    5.1s (=255/0.020)
-                                 // note: this is also used as frame for
-                                 // Servo-Outputs (OC1A and OC1B)
-
 //----------------------------------------------------------------------------
 // Global Data
 
-
-volatile signed char timerval;          // generell timer tick, this is incremented
-                                        // by Timer-ISR, wraps around
-
 volatile unsigned char Communicate = 0; // Communicationregister (for semaphors)
    
 
@@ -124,6 +124,26 @@
 
 #define RSBUS_ENABLED		FALSE	// TRUE: We use RS-bus feedbacks (requires Hardware 22)
 
+#define SR_BLOCKS			0		// number of 74HC595 shift registers on PORTB (0..6), each
+									// adds eight relays after relay 16 (see sr.c)
+
+#define KEY_MASK			0x00	// local push buttons on PORTB (to ground), one bit per pin;
+									// 0x00: none. Not on the pins of the shift registers, nor
+									// on PB3 if the state is saved on power loss (CV544 = 2)
+#define KEY_RELAY			1		// relay toggled by the button on PB0; PB1 toggles the next
+
+#ifndef EVENT_STATS
+#define EVENT_STATS			FALSE	// TRUE: statistics of the events of the main loop (events.c),
+#endif								// for debugging; costs 64 bytes of RAM
+
+#ifndef CYCLE_COUNT
+ #if (__AVR_ATmega8535__)
+  #define CYCLE_COUNT		FALSE	// the 512 bytes of SRAM of the ATmega8535 are too few
+ #else
+  #define CYCLE_COUNT		TRUE	// TRUE: count the switching cycles per relay (relays.c,
+ #endif							// CV882-CV885); costs 47 bytes of RAM
+#endif
+
 //-------------------------------------------------------------------------------------------
 // Decoder Model Configuration Check
 
@@ -160,6 +180,12 @@
  #endif
 #endif
 
+#if (SR_BLOCKS > 6)
+ #warning: at most 6 shift registers (64 relays) - SR_BLOCKS has been reduced
+ #undef SR_BLOCKS
+ #define SR_BLOCKS   6
+#endif
+
 #if (TARGET_HARDWARE != OPENDECODER22)
  #if (RSBUS_ENABLED == TRUE)
   #warning: RS-bus feedback disabled - Reason: only supported with OPENDECODER22
@@ -341,18 +367,8 @@ extern unsigned char EE_servo_curve4[48] EEMEM;
 //========================================================================
 
 //---------------------------------------------------------------------
-// Timing Definitions:
-//
-
-#define TICK_PERIOD 20000L       // 20ms tick for Timing Engine
-                                 // => possible values for timings up to
-                                 //    5.1s (=255/0.020)
-                                 // note: this is also used as frame for
-                                 // Servo-Outputs (OC1A and OC1B)
-
-//----------------------------------------------------------------------------
-
-extern volatile signed char timerval;    // gets incremented in the timetick
+// Timing:
+// The clock of the decoder is T2_Now() (milliseconds, 32 bits; see timer2.c)
 
 
 
@@ -380,7 +396,17 @@ extern volatile unsigned char Communicate;
 #define C_DoSave          1    // a new PORT state should be saved
                                //                        - issued by action
                                //                          cleared by main
-#define C_Tick            2    // a Tickevent happened
+#define C_Tick            2    // a deadline of the main loop passed or a pulse ended
+                               //                        - issued by ISR(Timer2)
+#define C_CvWritten       3    // a CV was written   - issued by dcc_decode
+                               //                      cleared by main
+#define C_Button          4    // the program button was pressed
+#define C_Eeprom          5    // the EEPROM finished a write - issued by ISR(EE_READY)
+#define C_Save            6    // state or switching cycles to be saved
+#define C_Keys            7    // a local button was pressed - issued by key_sample (keyboard.c),
+                               //   a timer handler of the main loop (T2_TimerRun)
+// Except C_DoSave these flags are events of the main loop (see events.c); they should be
+// set with event_post(), which also notes the moment for the statistics.
   
 
 //========================================================================
@@ -446,6 +472,9 @@ _mydelay_us(double __us)
     _delay_loop_2(__ticks);
 }   
 
+#if defined OUTPUT_HOST
+void _restart(void);             // on a PC: see test/host/host.c
+#else
 static inline void _restart(void) __attribute__((always_inline));
 void
 _restart(void)
@@ -464,6 +493,7 @@ _restart(void)
        "icall" "\n\t"
      );
 }
+#endif
 
 
 #endif   // _config_h_
@@ -71,7 +71,7 @@
    1,           //  Ract        532  20  -       If relais switches with - (=0) or with + (=1)
    15,          //  RRR1        533  21  -       Relays used for round-robin, relays 1-8  (Port C)
    7,           //  RRR2        534  22  -       Relays used for round-robin, relays 9-16 (Port A)
-   6,           //  RInter      535  23  -       Relays decoder, round-robin interval (in seconds)
+   6,           //  RInter      535  23  -       Relays decoder, round-robin interval (x CV628)
    0,           //  Mode        536  24  -       Relais decoder mode (see relays.c)
                 //                               CVs below are RS-bus specific (see: rs-bus.c)
                 //                               Reserved, according to the NMRA specs 
@@ -87,7 +87,7 @@
                    | 0,                       // 4..0: all reserved
    0,           //  cv542       542  30  -       reserved
    0,           //  cv543       543  31  -       reserved
-   0,           //  LastState   544  32  -       saved last port state (was reserved)
+   1,           //  LastState   544  32  -       relay state: 0 = all off, 1 = save and restore
                 //
                 // 545-593 - Manufacturer Unique
                 //
@@ -114,5 +114,61 @@
    1,           //  FBM_F2      548  36  -      feedback mode Func 2
    1,           //  FBM_F3      549  37  -      feedback mode Func 3
    1,           //  FBM_F4      550  38  -      feedback mode Func 4
+                //
+                // 551 - ... Relays decoder specific (see relays.c)
+                //
+   0,           //  BSAddrL     551  39  -      Binary states: multifunction address (0 = not used)
+   0,           //  BSAddrH     552  40  -      Binary states: 0 = short address, else long address
+   {                                           // BSRange   553-568 41-56 Binary state ranges
+     {0, 0, 0, 1},                             //   FirstL, FirstH, Count, Relay
+     {0, 0, 0, 1},
+     {0, 0, 0, 1},
+     {0, 0, 0, 1}
+   },
+   {                                           // Alias     569-608 57-96 Alias / group addresses
+     {0, 0, 0, 0, 0},                          //   AddrL, AddrH, MaskL, MaskH, Op
+     {0, 0, 0, 0, 0},
+     {0, 0, 0, 0, 0},
+     {0, 0, 0, 0, 0},
+     {0, 0, 0, 0, 0},
+     {0, 0, 0, 0, 0},
+     {0, 0, 0, 0, 0},
+     {0, 0, 0, 0, 0}
+   },
+   0,           //  RBreak      609  97  -      Break-before-make time in ms (0 = switch at once)
+   4,           //  RMaxOn      610  98  -      Max. number of relays set per time slice (0 = no limit)
+   10,          //  RSlice      611  99  -      Time slice in ms (for RMaxOn)
+   {0, 0, 0, 0, 0, 0, 0, 0,                    // RDwell    612-627 100-115 Round-robin time per
+    0, 0, 0, 0, 0, 0, 0, 0},                   //           relay 1..16 (0 = RInter)
+   100,         //  RTick       628 116  -      Unit of RInter and RDwell in 10 ms (100 = 1 s)
+   {0, 0, 0, 0, 0, 0, 0, 0,                    // Seq       629-692 117-180 Sequence area
+    0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0},
+   0,           //  RPulseL     693 181  -      Pulse mode for relays 1-8 (bit 0 = relay 1)
+   0,           //  RPulseH     694 182  -      Pulse mode for relays 9-16 (bit 0 = relay 9)
+   25,          //  RPulse      695 183  -      Pulse time in 10 ms (1..254)
+   {255, 255, 255, 255, 255, 255, 255, 255,    // RLevel    696-711 184-199 Level (dimming) per
+    255, 255, 255, 255, 255, 255, 255, 255},   //           relay 1..16 (255 = full on)
+   {{0, 0, 0, 0, 0}, {0, 0, 0, 0, 0}, {0, 0, 0, 0, 0}, {0, 0, 0, 0, 0},   // StateLog  712-871 200-359
+    {0, 0, 0, 0, 0}, {0, 0, 0, 0, 0}, {0, 0, 0, 0, 0}, {0, 0, 0, 0, 0},
+    {0, 0, 0, 0, 0}, {0, 0, 0, 0, 0}, {0, 0, 0, 0, 0}, {0, 0, 0, 0, 0},
+    {0, 0, 0, 0, 0}, {0, 0, 0, 0, 0}, {0, 0, 0, 0, 0}, {0, 0, 0, 0, 0},
+    {0, 0, 0, 0, 0}, {0, 0, 0, 0, 0}, {0, 0, 0, 0, 0}, {0, 0, 0, 0, 0},
+    {0, 0, 0, 0, 0}, {0, 0, 0, 0, 0}, {0, 0, 0, 0, 0}, {0, 0, 0, 0, 0},
+    {0, 0, 0, 0, 0}, {0, 0, 0, 0, 0}, {0, 0, 0, 0, 0}, {0, 0, 0, 0, 0},
+    {0, 0, 0, 0, 0}, {0, 0, 0, 0, 0}, {0, 0, 0, 0, 0}, {0, 0, 0, 0, 0}},
+   255,         //  ModeL       872 360  -      Mode of relays 1-8 (255 = Mode, CV536)
+   255,         //  ModeH       873 361  -      Mode of relays 9-16 (255 = Mode, CV536)
+   {{0, 0}, {0, 0}, {0, 0}, {0, 0}},           // RGroup    874-881 362-369 Mutual-exclusion groups
+   1,           //  CntPage     882 370  -      Switching cycles: relay (1..16) shown in CV883-885
+   0,           //  CntL        883 371  -      Switching cycles of that relay (read only)
+   0,           //  CntM        884 372  -
+   0,           //  CntH        885 373  -
+   {[0 ... CYCLE_LOG-1] = {{0}, 0xFF}},        // CycleLog  886-    374-    Switching cycles: no record written
 
 
@@ -73,6 +73,93 @@
 #define CVbit_DMX_MODE_WATCH_REL    4
 
 
+// Binary state ranges of the relays decoder (see relays.c)
+// A binary state number in [First .. First+Count-1] controls relay Relay .. Relay+Count-1.
+#define BS_RANGES   4                   // number of entries in the range table
+
+typedef struct
+  {
+    unsigned char FirstL;               // first binary state number, low part
+    unsigned char FirstH;               // first binary state number, high part
+    unsigned char Count;                // number of binary states (0 = entry not used)
+    unsigned char Relay;                // first relay (1..16)
+  } t_bs_range;
+
+// Alias (group) addresses of the relays decoder (see relays.c)
+// Secondary basic accessory addresses, each acting on a set of relays.
+#define ALIASES     8                   // number of entries in the alias table
+
+#define ALIAS_UNUSED     0              // entry not used
+#define ALIAS_SET        1              // ACTIVATE sets the relays in the mask, DEACTIVATE releases them
+#define ALIAS_EXCLUSIVE  2              // ACTIVATE releases all relays in the touched blocks, then
+                                        // sets the relays in the mask; DEACTIVATE is ignored
+#define ALIAS_RELEASE    3              // ACTIVATE releases the relays in the mask
+#define ALIAS_SEQUENCE   4              // ACTIVATE starts the sequence program at offset MaskL
+                                        // of the sequence area; DEACTIVATE stops it
+
+typedef struct
+  {
+    unsigned char AddrL;                // output address (as CV541 bit 6 = 1): 
+    unsigned char AddrH;                // Accessory-Output = (AddrL + AddrH*256) - 1
+    unsigned char MaskL;                // relays 1-8 (bit 0 = relay 1)
+    unsigned char MaskH;                // relays 9-16 (bit 0 = relay 9)
+    unsigned char Op;                   // operation (see above)
+  } t_alias;
+
+// Relay sequencer (see relays.c)
+// A sequence program is a list of instructions in the sequence area (CV629-CV692). Each
+// instruction starts with its opcode; offsets are relative to the start of the area.
+#define SEQ_SIZE    64                  // size of the sequence area
+
+#define SEQ_END          0              // stop the program (relays stay as they are)
+#define SEQ_STEP         1              // + relays 1-8, relays 9-16, time (units of RTick x 10 ms):
+                                        // set exactly these relays and wait
+#define SEQ_LOOP         2              // + offset, count: jump back to offset, such that the part
+                                        // in between is executed count times (0 = forever)
+
+
+// Relay state log (see relays.c)
+// Ring of records; the newest record is the one whose successor does not have the next
+// sequence number. The sequence number is written last, so an interrupted write leaves the
+// previous record as the newest one.
+#define STATE_LOG   32                  // number of records in the ring
+
+typedef struct
+  {
+    unsigned char PortA;                // relays 9-16 (PORTA order)
+    unsigned char PortC;                // relays 1-8
+    unsigned char Info;                 // bit 7: round-robin active; bit 6: 1 (record written);
+                                        // bits 3-2: mode relays 9-16; bits 1-0: mode relays 1-8
+    unsigned char RRPos;                // round-robin position: bits 6-4 block A, bits 2-0 block C
+    unsigned char Seq;                  // sequence number (0..254)
+  } t_state_record;
+
+// Switching cycle counters (see relays.c)
+// The records form a ring in the EEPROM behind the other CVs, up to E2END: 2 records with
+// 512 bytes of EEPROM, 13 with 1K, 34 with 2K. Each flush writes over the oldest record, its
+// sequence number last; the newest record (whose successor does not continue the sequence
+// numbers) holds the totals.
+#define CYCLE_BASE  373                 // EEPROM offset of the ring (CV886)
+
+typedef struct
+  {
+    unsigned char Cycles[48];           // per relay 1..16: low, middle and high byte
+    unsigned char Seq;                  // sequence number (0..254; 0xFF = never written)
+  } t_cycle_record;
+
+#define CYCLE_LOG   ((E2END + 1 - CYCLE_BASE) / sizeof(t_cycle_record))    // number of records
+
+// Mutual-exclusion groups (see relays.c)
+// Setting a relay of a group releases the other relays of that group, in both blocks.
+#define GROUPS      4                   // number of groups
+
+typedef struct
+  {
+    unsigned char MaskL;                // relays 1-8 (bit 0 = relay 1)
+    unsigned char MaskH;                // relays 9-16 (bit 0 = relay 9)
+  } t_group;
+
+
 typedef struct
   {
     //            Name          CV  -alt  type    comment
@@ -100,7 +187,7 @@ typedef struct
     unsigned char Ract     ;   //532  20  -       If relais switches with - (=0) or with + (=1)
     unsigned char RRR1     ;   //533  21  -       Relays used for round-robin, relays 1-8
     unsigned char RRR2     ;   //534  22  -       Relays used for round-robin, relays 9-16
-    unsigned char RInter   ;   //535  23  -       Relays decoder, round-robin interval (in seconds)
+    unsigned char RInter   ;   //535  23  -       Relays decoder, round-robin interval (x CV628)
     unsigned char Mode     ;   //536  24  -       Relays decoder mode
                                //                 CVs below are RS-bus specific (see: rs-bus.c)
                                //                 Reserved, according to the NMRA specs 
@@ -112,7 +199,9 @@ typedef struct
     unsigned char Config   ;   //541  29  -       similar to CV#29; for acc. decoders
     unsigned char cv542    ;   //542  30  -       reserved
     unsigned char cv543    ;   //543  31  -       reserved
-    unsigned char LastState;   //544  32  -       saved last port state (was reserved)
+    unsigned char LastState;   //544  32  -       relay state: 0 = all off after power-up
+                               //                 1 = save the state and restore it at power-up
+                               //                 2 = as 1, but save only when the supply drops
     //
     // 545-593 - Manufacturer Unique
     //
@@ -246,6 +335,36 @@ typedef struct
     unsigned char K2_Trg2_invers; //554  46
     #endif
 
+    //
+    // CVs below are relays decoder specific (relays.c); they follow the FBM CVs directly,
+    // since the relays decoder uses neither SERVO, DMX nor REVERSER
+    //
+    unsigned char BSAddrL    ; //551  39  -      Binary states: multifunction address, low part
+                               //                0 = binary state control not used
+    unsigned char BSAddrH    ; //552  40  -      Binary states: multifunction address, high part
+                               //                0 = short address (BSAddrL, 1..127)
+                               //                else long address ((BSAddrH & 0x3F) * 256 + BSAddrL)
+    t_bs_range BSRange[BS_RANGES]; //553-568 41-56 Binary state range table (4 bytes per range)
+    t_alias    Alias[ALIASES];     //569-608 57-96 Alias / group addresses (5 bytes per entry)
+    unsigned char RBreak     ; //609  97  -      Break-before-make time in ms (0 = switch at once)
+    unsigned char RMaxOn     ; //610  98  -      Max. number of relays set per time slice (0 = no limit)
+    unsigned char RSlice     ; //611  99  -      Time slice in ms (for RMaxOn)
+    unsigned char RDwell[16] ; //612-627 100-115 Round-robin time per relay 1..16 (0 = RInter)
+    unsigned char RTick      ; //628 116  -      Unit of RInter and RDwell in 10 ms (100 = 1 s)
+    unsigned char Seq[SEQ_SIZE]; //629-692 117-180 Sequence area (relay programs, see SEQ_xxx)
+    unsigned char RPulseL    ; //693 181  -      Pulse mode for relays 1-8 (bit 0 = relay 1)
+    unsigned char RPulseH    ; //694 182  -      Pulse mode for relays 9-16 (bit 0 = relay 9)
+    unsigned char RPulse     ; //695 183  -      Pulse time in 10 ms (1..254)
+    unsigned char RLevel[16] ; //696-711 184-199 Level (dimming) per relay 1..16 (255 = full on)
+    t_state_record StateLog[STATE_LOG]; //712-871 200-359 Relay state log (written by the decoder)
+    unsigned char ModeL      ; //872 360  -      Mode of relays 1-8 (0..3; 255 = Mode, CV536)
+    unsigned char ModeH      ; //873 361  -      Mode of relays 9-16 (0..3; 255 = Mode, CV536)
+    t_group    RGroup[GROUPS]; //874-881 362-369 Mutual-exclusion groups (2 bytes per group)
+    unsigned char CntPage    ; //882 370  -      Switching cycles: relay (1..16) shown in CV883-885
+    unsigned char CntL       ; //883 371  -      Switching cycles of that relay, low byte (read only)
+    unsigned char CntM       ; //884 372  -      Switching cycles, middle byte (read only)
+    unsigned char CntH       ; //885 373  -      Switching cycles, high byte (read only)
+    t_cycle_record CycleLog[CYCLE_LOG]; //886-   374-    Switching cycles, up to E2END (written by the decoder)
 
 
  } t_cv_record;
@@ -50,9 +50,7 @@
 //             1. CV-Handling (including preset)
 //             2. DCC Parser
 //
-// required:  a running timerengine (for timeouts)
-//            this engine is currently implemented in port_engine
-//            (TICK_PERIOD, timerval)
+// required:  a running clock (for timeouts): T2_Now() of timer2.c
 //
 //------------------------------------------------------------------------
 
@@ -70,15 +68,12 @@
 #include "hardware.h"            // port definitions
 #include "dcc_receiver.h"        // receiver for dcc
 #include "dcc_decode.h"          // decoder for dcc
+#include "relays.h"              // switching cycle counters
+#include "timer2.h"              // clock (T2_Now)
+#include "events.h"              // tell the main loop
 
 
-#define SERVICE_MODE_TIMEOUT   40000L    // 40ms - at least 20ms
-#if ((SERVICE_MODE_TIMEOUT / TICK_PERIOD) == 0)
-  #warning: TICK_PERIOD too large
-#endif
-#if ((SERVICE_MODE_TIMEOUT / TICK_PERIOD) > 127)
-  #error: TICK_PERIOD too small
-#endif
+#define SERVICE_MODE_TIMEOUT   40        // ms
 
 
 //------------------------------------------------------------------------------
@@ -118,6 +113,10 @@ unsigned int  ReceivedCommand;      // format: 0000dddd dddddccc
                                     // and MyAddr (only in case ReceivedAddr > MyAddr) 
 unsigned char ReceivedActivate;     // 0: a turn OFF was received
                                     // !0: a turn ON was received (typ. 0b00001000)
+unsigned int  ReceivedBinState;     // binary state number (1..32767, 0 = broadcast)
+unsigned char ReceivedAlias;        // entry in the alias table (CV569-CV608) that matched
+unsigned char ReceivedAnalog;       // analog function output (1..255)
+unsigned char ReceivedLevel;        // analog data for this output
 
 
 
@@ -145,7 +144,16 @@ unsigned char service_mode_state;   // bit field
 #define SM_RECEIVED  1              // Bit 1: 0: initial state
                                     //        1: there is already a received SM
                           
-signed char last_sm_mode_received;  // timer variable to create a update grid;
+unsigned long last_sm_mode_received;  // time (T2_Now) of the last service mode packet
+
+void init_alias_map(void);
+
+#define ALIAS_MAP  128                      // bits of the alias filter (a power of 2)
+unsigned char AliasMap[ALIAS_MAP / 8];      // one bit per basic accessory decoder address modulo
+                                            // ALIAS_MAP; set if the alias table may contain an
+                                            // output of that address (the table decides). Built
+                                            // at power up, so rejecting most packets costs one
+                                            // lookup
 
 
 //==============================================================================
@@ -194,18 +202,34 @@ void ResetDecoder(void)
   }
 
 
+#define CV_CNT  ((unsigned int)(&CV.CntL - &CV.myAddrL))     // CV883 (switching cycles)
+
 unsigned char cv_is_blocked(unsigned int cv)
 // some CV are not allowed to be written
 // block access to: CV519, CV520 (=7,8) (Version and VID)
 //                  CV540, CV541 (=28,29) (config)
+//                  CV883 - CV885 (switching cycles, calculated)
   {
     if (cv == (7-1)) return(TRUE);
     if (cv == (8-1)) return(TRUE);       // cv8 is coded as 7
     if (cv == (28-1)) return(TRUE);
     if (cv == (29-1)) return(TRUE);
+    if ((cv - CV_CNT) < 3) return(TRUE);
     return(FALSE);
   }
 
+unsigned char cv_read(unsigned int cv)
+// CV883 - CV885 return a byte of the switching cycles of the relay selected by CV882 (page),
+// all other CVs are read from EEPROM
+  {
+    if ((cv - CV_CNT) < 3)
+      {
+        return((unsigned char)(relays_cycles(my_eeprom_read_byte(&CV.CntPage) - 1)
+                               >> (8 * (cv - CV_CNT))));
+      }
+    return(my_eeprom_read_byte(&CV.myAddrL + cv));
+  }
+
 // used static: 
 //   ReceivedOperation
 //   ReceivedCV
@@ -225,7 +249,7 @@ void cv_operation(void)
         case CV_NOP:
             break;
         case CV_VERIFY:
-            if (my_eeprom_read_byte(&CV.myAddrL + ReceivedCV) == ReceivedData)
+            if (cv_read(ReceivedCV) == ReceivedData)
               {
                 activate_ACK(6);
               }
@@ -241,6 +265,8 @@ void cv_operation(void)
             my_eeprom_write_byte(&CV.myAddrL + ReceivedCV, ReceivedData);
             eeprom_busy_wait();
             activate_ACK(6);
+            init_alias_map();
+            event_post(C_CvWritten);                // let the application reread its CVs
             break;
         case CV_BITOPERATION:
             // Data is interpreted as 111KDBBB
@@ -262,17 +288,19 @@ void cv_operation(void)
                 my_eeprom_write_byte(&CV.myAddrL + ReceivedCV, oldbyte);
                 eeprom_busy_wait();
                 activate_ACK(6);
+                init_alias_map();
+                event_post(C_CvWritten);            // let the application reread its CVs
               }
             else
               { // verify bit
                 if (ReceivedData & 0b00001000)
                   {
-                    if (my_eeprom_read_byte(&CV.myAddrL + ReceivedCV) & bitmask) 
+                    if (cv_read(ReceivedCV) & bitmask) 
                         activate_ACK(6);
                   }
                 else
                   {
-                    if ((my_eeprom_read_byte(&CV.myAddrL + ReceivedCV) & bitmask) == 0)
+                    if ((cv_read(ReceivedCV) & bitmask) == 0)
                         activate_ACK(6);
                   }
               }
@@ -281,6 +309,74 @@ void cv_operation(void)
   }
 
 
+//
+//---------------------------------------------------------------------------------------
+// analyze_loco_instruction(struct message *new_dcc, pos) checks the instruction of a
+// multifunction (loco) packet sent to our binary state address (CV551 / CV552).
+// parameters:
+//      pointer to struct of message
+//      pos: index of the instruction byte (1: 7 bit address, 2: 14 bit address)
+//
+// returns:
+//       0: if void,
+//       4: if binary state control instruction (ReceivedBinState, ReceivedActivate loaded)
+//       6: if analog function group instruction (ReceivedAnalog, ReceivedLevel loaded)
+//
+unsigned char analyze_loco_instruction(t_message *new_dcc, unsigned char pos)
+  {
+    unsigned char instruction;
+
+    instruction = new_dcc->dcc[pos];
+
+    // see RP921 for more information
+
+    switch (instruction & 0b11100000)
+      {
+        case 0b00000000:            // 000 Decoder and Consist Control Instruction
+            break;
+        case 0b00100000:            // 001 Advanced Operation Instructions
+            if ((instruction == 0b00111101) && (new_dcc->size == pos + 4))
+              {
+                // Analog Function Group
+                // {preamble} 0 [AAAAAAAA 0] AAAAAAAA 0 00111101 0 CCCCCCCC 0 DDDDDDDD 0 EEEEEEEE 1
+                // C = analog function output, D = analog data
+                ReceivedAnalog = new_dcc->dcc[pos+1];
+                ReceivedLevel  = new_dcc->dcc[pos+2];
+                return(6);
+              }
+            break;
+        case 0b01000000:            // 010 Speed and Direction Instruction for reverse operation
+        case 0b01100000:            // 011 Speed and Direction Instruction for forward operation
+        case 0b10000000:            // 100 Function Group One Instruction
+        case 0b10100000:            // 101 Function Group Two Instruction
+            break;
+        case 0b11000000:            // 110 Future Expansion
+            if ((instruction == 0b11000000) && (new_dcc->size == pos + 4))
+              {
+                // Binary State Control Instruction long form
+                // {preamble} 0 [AAAAAAAA 0] AAAAAAAA 0 11000000 0 DLLLLLLL 0 HHHHHHHH 0 EEEEEEEE 1
+                // D = state, HHHHHHHH:LLLLLLL = binary state number (0 = broadcast)
+                ReceivedBinState = (new_dcc->dcc[pos+2] << 7)
+                                 | (new_dcc->dcc[pos+1] & 0b01111111);
+                ReceivedActivate = new_dcc->dcc[pos+1] & 0b10000000;
+                return(4);
+              }
+            if ((instruction == 0b11011101) && (new_dcc->size == pos + 3))
+              {
+                // Binary State Control Instruction short form
+                // {preamble} 0 [AAAAAAAA 0] AAAAAAAA 0 11011101 0 DLLLLLLL 0 EEEEEEEE 1
+                ReceivedBinState = new_dcc->dcc[pos+1] & 0b01111111;
+                ReceivedActivate = new_dcc->dcc[pos+1] & 0b10000000;
+                return(4);
+              }
+            break;
+        case 0b11100000:            // 111 Configuration Variable Access Instruction
+            break;
+      }
+    return(0);
+  }
+
+
 //
 //---------------------------------------------------------------------------------------
 // analyze_message(struct message *new_dcc) checks the received DCC message
@@ -292,6 +388,9 @@ void cv_operation(void)
 //       1: if accessory command and command type equal our mode
 //       2: if accessory command and address equal myAddr (or broadcast)
 //       3: if accessory command and address > myAddr (Received Command is extended)
+//       4: if binary state control instruction for our multifunction address
+//       5: if accessory command and address in the alias table (ReceivedAlias loaded)
+//       6: if analog function group instruction for our multifunction address
 //
 // side effects: 
 //       a) accesses to CV are handled here.
@@ -299,6 +398,7 @@ void cv_operation(void)
 //              ReceivedAddress
 //              ReceivedCommand
 //              ReceivedActivate
+//              ReceivedBinState
 //       c) Local Statics are loaded:
 //              ReceivedOperation
 //              ReceivedCV
@@ -324,7 +424,7 @@ unsigned char analyze_message(t_message *new_dcc)
 
     if (service_mode_state & (1 << SM_ENABLED))
       {                                                 //// we are in Service Mode!
-        if ((char)(timerval - last_sm_mode_received) >= (SERVICE_MODE_TIMEOUT / TICK_PERIOD)) 
+        if ((T2_Now() - last_sm_mode_received) >= SERVICE_MODE_TIMEOUT) 
           {
             service_mode_state = 0;                    // timeout reached, leave service mode
             #if (DEBUG_PORTB7_IS_SM == TRUE)
@@ -340,7 +440,7 @@ unsigned char analyze_message(t_message *new_dcc)
                 #if (DEBUG_PORTB7_IS_SM == TRUE)
                     PORTB |= (1<<7);
                 #endif
-                last_sm_mode_received = timerval;
+                last_sm_mode_received = T2_Now();
                 return(0);
               }
           }
@@ -349,7 +449,7 @@ unsigned char analyze_message(t_message *new_dcc)
             if (new_dcc->size == 4) // direct mode
               {
                 service_mode_state |= (1 << SM_ENABLED);
-                last_sm_mode_received = timerval;
+                last_sm_mode_received = T2_Now();
             
                 // direct mode
                 // {preamble} 0 0111CCAA 0 AAAAAAAA 0 DDDDDDDD 0 EEEEEEEE 1
@@ -395,7 +495,7 @@ unsigned char analyze_message(t_message *new_dcc)
                 #if (DEBUG_PORTB7_IS_SM == TRUE)
                     PORTB |= (1<<7);
                 #endif
-                last_sm_mode_received = timerval;
+                last_sm_mode_received = T2_Now();
             
                 // paged/register mode
                 // {preamble} 0 0111CRRR 0 DDDDDDDD 0 EEEEEEEE 1
@@ -409,7 +509,7 @@ unsigned char analyze_message(t_message *new_dcc)
           }
         else if (new_dcc->dcc[0] == 255)
           {
-            last_sm_mode_received = timerval;
+            last_sm_mode_received = T2_Now();
             return(0);
           }
       }
@@ -427,7 +527,7 @@ unsigned char analyze_message(t_message *new_dcc)
             #if (DEBUG_PORTB7_IS_SM == TRUE)
                 PORTB |= (1<<7);
             #endif
-            last_sm_mode_received = timerval;
+            last_sm_mode_received = T2_Now();
           }
       }
     else if (new_dcc->dcc[0] <= 127)
@@ -438,20 +538,11 @@ unsigned char analyze_message(t_message *new_dcc)
 
         ReceivedAddr = (new_dcc->dcc[0] & 0b01111111);
 
-        // see RP921 for more information
-
-        switch (new_dcc->dcc[1] & 0b11100000)
+        if ((my_eeprom_read_byte(&CV.BSAddrH) == 0) &&
+            (ReceivedAddr == my_eeprom_read_byte(&CV.BSAddrL)))
           {
-            case 0b00000000:            // 000 Decoder and Consist Control Instruction
-            case 0b00100000:            // 001 Advanced Operation Instructions
-            case 0b01000000:            // 010 Speed and Direction Instruction for reverse operation
-            case 0b01100000:            // 011 Speed and Direction Instruction for forward operation
-            case 0b10000000:            // 100 Function Group One Instruction
-            case 0b10100000:            // 101 Function Group Two Instruction
-            case 0b11000000:            // 110 Future Expansion
-            case 0b11100000:            // 111 Configuration Variable Access Instruction
-                break;
-          }                                       
+            return(analyze_loco_instruction(new_dcc, 1));
+          }
       }
     else if (new_dcc->dcc[0] <= 191)
       {                                                         //// Accessory 
@@ -517,6 +608,23 @@ unsigned char analyze_message(t_message *new_dcc)
                       }
                 #endif
 
+                if (AliasMap[(ReceivedAddr & (ALIAS_MAP - 1)) >> 3] & (1 << (ReceivedAddr & 0b00000111)))
+                  {
+                    // only now search the table, since there may be more outputs per address
+                    unsigned int output;
+                    output = (ReceivedAddr << 2) + ((new_dcc->dcc[1] & 0b00000110) >> 1) + 1;
+                    for (i=0; i < ALIASES; i++)
+                      {
+                        if ((my_eeprom_read_byte(&CV.Alias[i].Op) != ALIAS_UNUSED) &&
+                            (my_eeprom_read_byte(&CV.Alias[i].AddrL) == (output & 0xFF)) &&
+                            (my_eeprom_read_byte(&CV.Alias[i].AddrH) == (output >> 8)))
+                          {
+                            ReceivedAlias = i;
+                            return(5);
+                          }
+                      }
+                  }
+
                 if (ReceivedAddr > MyAddr) return(3);
                 return(1);  
               }
@@ -600,6 +708,14 @@ unsigned char analyze_message(t_message *new_dcc)
                                                         //// loco decoders (14 bit addr)
         ReceivedAddr = ((new_dcc->dcc[0] & 0b00111111) << 8)
                     |  (new_dcc->dcc[1]);
+
+        MyAddr = ((my_eeprom_read_byte(&CV.BSAddrH) & 0b00111111) << 8)
+                | (my_eeprom_read_byte(&CV.BSAddrL));
+
+        if ((my_eeprom_read_byte(&CV.BSAddrH) != 0) && (ReceivedAddr == MyAddr))
+          {
+            return(analyze_loco_instruction(new_dcc, 2));
+          }
       }
     else if (new_dcc->dcc[0] <= 254)
       {                                                 //// Reserved in DCC for Future Use
@@ -613,9 +729,30 @@ unsigned char analyze_message(t_message *new_dcc)
   }
 
 
+// (re)builds the alias bitmap; at power up and after a CV was written
+void init_alias_map(void)
+  {
+    unsigned char i;
+    unsigned int output;
+
+    memset(AliasMap, 0, sizeof(AliasMap));
+    for (i=0; i < ALIASES; i++)
+      {
+        if (my_eeprom_read_byte(&CV.Alias[i].Op) != ALIAS_UNUSED)
+          {
+            output = (my_eeprom_read_byte(&CV.Alias[i].AddrL) |
+                     (my_eeprom_read_byte(&CV.Alias[i].AddrH) << 8)) - 1;
+            output = (output >> 2) & (ALIAS_MAP - 1);           // decoder address (filter)
+            AliasMap[output >> 3] |= (1 << (output & 0b00000111));
+          }
+      }
+  }
+
+
 // must be called once at power up.
 void init_dcc_decode(void)
   {
+    init_alias_map();
     service_mode_state = 0;         // all bits off
     #if (DEBUG_PORTB7_IS_SM == TRUE)
       PORTB &= ~(1<<7);
@@ -23,8 +23,7 @@
 //
 //------------------------------------------------------------------------
 //
-// howto:     Step 1: set up a timerengine, suppling the system with an increment
-//                    on "timerval" every 20ms
+// howto:     Step 1: set up the clock: init_timer2() (T2_Now, milliseconds)
 //
 //            Step 2: call init_dcc_decode();
 //
@@ -51,12 +50,19 @@ extern unsigned int  ReceivedAddr;          // last received address - gets fill
 extern unsigned int  ReceivedCommand;       // subaddress (starting from the first address)
                                             // or aspect
 extern unsigned char  ReceivedActivate;      // coil
+extern unsigned int  ReceivedBinState;      // binary state number (only with code 4)
+extern unsigned char ReceivedAlias;         // alias table entry (only with code 5)
+extern unsigned char ReceivedAnalog;        // analog function output (only with code 6)
+extern unsigned char ReceivedLevel;         // analog data (only with code 6)
 
 unsigned char analyze_message(t_message *new);        // this returns a code on the result:
                                             // 0: if void,
                                             // 1: if accessory and command type equal our mode
                                             // 2: if accessory and address equal myAddr (or broadcast)
                                             // 3: if accessory and address > myAddr (Received Command is extended)
+                                            // 4: if binary state control for our multifunction address
+                                            // 5: if accessory and address in alias table
+                                            // 6: if analog function for our multifunction address
 
 void init_dcc_decode(void);
 void ResetDecoder(void);
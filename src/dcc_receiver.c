@@ -72,6 +72,7 @@
 #include "config.h"
 #include "hardware.h"            // Port and CPU definitions
 #include "dcc_receiver.h"
+#include "events.h"              // tell the main loop
 
 
 
@@ -438,7 +439,7 @@ ISR(TIMER0_OVF_vect)
                      incoming.dcc[i] = local.dcc[i];
                   }
                 incoming.size = dccrec.bytecount;
-                semaphor_set(C_Received);                   // ---> tell the main prog!
+                event_post(C_Received);                     // ---> tell the main prog!
               }
             
           }
@@ -533,7 +534,7 @@ void dcc_receive(void)
                      incoming.dcc[i] = local.dcc[i];
                   }
                 incoming.size = dccrec.bytecount;
-                semaphor_set(C_Received);                   // ---> tell the main prog!
+                event_post(C_Received);                     // ---> tell the main prog!
               }
           }
         else
@@ -719,7 +720,7 @@ void dcc_sampling ()
                              incoming.dcc[i] = local.dcc[i];
                           }
                         incoming.size = dccrec.bytecount;
-                        semaphor_set(C_Received);                   // ---> tell the main prog!
+                        event_post(C_Received);                     // ---> tell the main prog!
                       }
                   }
                 else
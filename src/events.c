@@ -0,0 +1,219 @@
+//------------------------------------------------------------------------
+//
+// file:      events.c
+//
+// purpose:   Prioritized events of the main loop
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at http://www.gnu.org/licenses/gpl.txt
+//
+//------------------------------------------------------------------------
+//
+// The main loop does not poll its tasks, but waits for events. An event is a flag in
+// Communicate (config.h), set by an ISR or by the main loop with event_post(). In order of
+// priority:
+// - C_Received: a DCC packet is ready (dcc_receiver.c)
+// - C_Button:   the program button is pressed (see below), or its timer ran out (main.c)
+// - C_Keys:     a local button was pressed (keyboard.c)
+// - C_CvWritten: a CV was written (dcc_decode.c)
+// - C_Tick:     a deadline of the relays tasks has passed, or a timer of the wheel (timer2.c)
+//               may have expired
+// - C_Eeprom:   the EEPROM finished a write a relays task was waiting for (ISR below)
+// - C_Save:     the state or the switching cycles can be saved (main.c)
+// event_dispatch() handles one event per call: the pending event with the highest priority.
+// So a packet never waits for more than one handler. A handler that has much to do does a
+// part of it and posts its event again (saving: one EEPROM byte per event).
+// Without events the CPU sleeps in idle mode. The timers, the DCC input and the SPI keep
+// running, and each of their interrupts wakes the CPU (Timer2 at least once per ms).
+//
+// The program button is not polled. On the enhanced processors a pin change interrupt reports
+// a press. The ATmega8535, 16 and 32 have no pin change interrupts and PROGTASTER is no INTn
+// pin, but it is ICP1: there the input capture interrupt of Timer1 reports the falling edge
+// (ICES1 = 0). The capture unit works also while Timer1 is stopped; bam.c only uses Output
+// Compare A and leaves ICES1 0. So the button costs nothing while it is not used. After a press
+// the interrupt is disabled till the button has been released for BUTTON_QUIET ms, counted by
+// the ISR of Timer2 (event_button); this debounces the release (the press itself is debounced
+// in main.c).
+//
+// With EVENT_STATS (config.h), statistics keep for each event the number of dispatches, the
+// longest time it waited in the queue and the longest run time of its handler. Times are in
+// us, measured with T2_Stamp, so they wrap after 65 ms. The statistics are meant for
+// debugging: they take 64 bytes of RAM.
+//
+//------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <avr/pgmspace.h>        // put var to program memory
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+#include "config.h"              // general definitions the decoder, cv's
+#include "hardware.h"            // port definitions for target
+#include "timer2.h"              // time stamps
+
+#include "events.h"
+
+#if defined ENHANCED_PROCESSOR
+  #define EEPROM_Ready_Vect  EE_READY_vect
+#else
+  #define EEPROM_Ready_Vect  EE_RDY_vect
+#endif
+
+#define BUTTON_QUIET  20                 // ms the button must be released before the next press
+
+//--------------------------------------------------------------------------------------
+// Global Data
+#if (EVENT_STATS == TRUE)
+unsigned int  EventCount[EVENTS];
+unsigned int  EventWaitMax[EVENTS];
+unsigned int  EventRunMax[EVENTS];
+unsigned int  EventPosted[EVENTS];       // moment the event was posted (T2_Stamp)
+#endif
+
+// local variables
+const unsigned char EventOrder[] PROGMEM = {C_Received, C_Button, C_Keys, C_CvWritten, C_Tick,
+                                            C_Eeprom, C_Save};
+#define EVENT_ORDER  sizeof(EventOrder)
+
+t_event_handler EventHandler[EVENTS];    // handler per event
+unsigned char EventMask;                 // events that have a handler
+unsigned char ButtonQuiet;               // ms the button must still be released (0: armed)
+
+
+//--------------------------------------------------------------------------------------
+
+void event_post(unsigned char flag)
+{
+  unsigned char sreg;
+  sreg = SREG;
+  cli();
+  #if (EVENT_STATS == TRUE)
+  if ((Communicate & (1<<flag)) == 0) {EventPosted[flag] = T2_Stamp();}
+  #endif
+  Communicate |= (1<<flag);
+  SREG = sreg;
+}
+
+
+ISR(EEPROM_Ready_Vect)
+{
+  EECR &= ~(1<<EERIE);           // the interrupt fires as long as the EEPROM is ready
+  event_post(C_Eeprom);
+}
+
+
+void event_button(void)
+{ // called every ms by the ISR of Timer2
+  if (ButtonQuiet == 0) return;            // armed: the edge interrupt watches the button
+  if (PROG_PRESSED) {ButtonQuiet = BUTTON_QUIET;}
+  else {
+    ButtonQuiet--;
+    if (ButtonQuiet == 0) {
+#if defined ENHANCED_PROCESSOR
+      PCIFR = (1<<PCIF3);                  // forget the bounces
+      PCMSK3 |= (1<<PROGTASTER);
+#else
+      TIFR = (1<<ICF1);                    // forget the bounces
+      TIMSK |= (1<<TICIE1);
+#endif
+    }
+  }
+}
+
+
+#if defined ENHANCED_PROCESSOR
+ISR(PCINT3_vect)
+{ // PROGTASTER (PD6 = PCINT30) changed
+  if (PROG_PRESSED) {
+    PCMSK3 &= ~(1<<PROGTASTER);            // ignore the bounces (event_button arms it again)
+    ButtonQuiet = BUTTON_QUIET;
+    event_post(C_Button);
+  }
+}
+#else
+ISR(TIMER1_CAPT_vect)
+{ // PROGTASTER (PD6 = ICP1) fell: pressed
+  TIMSK &= ~(1<<TICIE1);                   // ignore the bounces (event_button arms it again)
+  ButtonQuiet = BUTTON_QUIET;
+  event_post(C_Button);
+}
+#endif
+
+
+void event_eeprom(void)
+{
+  if (eeprom_is_ready()) {event_post(C_Eeprom);}
+  else {EECR |= (1<<EERIE);}
+}
+
+
+void event_dispatch(void)
+{
+  unsigned char i, flag;
+  #if (EVENT_STATS == TRUE)
+  unsigned int start, time;
+  #endif
+  cli();
+  while ((Communicate & EventMask) == 0) {
+    sleep_enable();
+    sei();                       // the sleep instruction is executed before a pending interrupt
+    sleep_cpu();
+    sleep_disable();
+    cli();
+  }
+  flag = C_Received;
+  for (i=0; i < EVENT_ORDER; i++) {
+    flag = pgm_read_byte(&EventOrder[i]);
+    if (Communicate & EventMask & (1<<flag)) break;
+  }
+  if (flag != C_Received) {      // (C_Received protects the packet: the handler clears it)
+    Communicate &= ~(1<<flag);
+  }
+  #if (EVENT_STATS == TRUE)
+  start = T2_Stamp();
+  time = start - EventPosted[flag];
+  sei();
+  EventCount[flag]++;
+  if (time > EventWaitMax[flag]) {EventWaitMax[flag] = time;}
+  EventHandler[flag]();
+  time = T2_Stamp() - start;
+  if (time > EventRunMax[flag]) {EventRunMax[flag] = time;}
+  #else
+  sei();
+  EventHandler[flag]();
+  #endif
+}
+
+
+void event_handler(unsigned char flag, t_event_handler handler)
+{
+  EventHandler[flag] = handler;
+  EventMask |= (1<<flag);
+}
+
+
+//--------------------------------------------------------------------------------------
+
+void init_events(void)
+{
+  #if (EVENT_STATS == TRUE)
+  unsigned char i;
+  for (i=0; i < EVENTS; i++) {
+    EventCount[i] = 0;
+    EventWaitMax[i] = 0;
+    EventRunMax[i] = 0;
+  }
+  #endif
+  EventMask = 0;
+  ButtonQuiet = BUTTON_QUIET;              // (the button may be pressed at power up)
+#if defined ENHANCED_PROCESSOR
+  PCICR |= (1<<PCIE3);                     // pin change interrupts of PORTD
+#else
+  TCCR1B &= ~(1<<ICES1);                   // input capture on the falling edge of PROGTASTER
+#endif
+  set_sleep_mode(SLEEP_MODE_IDLE);
+}
@@ -0,0 +1,28 @@
+//------------------------------------------------------------------------
+//
+// file:      events.h
+//
+// purpose:   Prioritized events of the main loop
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at http://www.gnu.org/licenses/gpl.txt
+//
+//------------------------------------------------------------------------
+// The events are the flags C_Received ... C_Save in Communicate (config.h)
+#define EVENTS  8                            // flags 0..7 (C_DoSave is no event)
+
+typedef void (*t_event_handler)(void);
+
+#if (EVENT_STATS == TRUE)
+// Global Data: statistics per event (us, inspect with a debugger)
+extern unsigned int  EventCount[EVENTS];     // number of dispatches (wraps)
+extern unsigned int  EventWaitMax[EVENTS];   // longest time between posting and dispatching
+extern unsigned int  EventRunMax[EVENTS];    // longest run time of the handler
+#endif
+
+void init_events(void);
+void event_handler(unsigned char flag, t_event_handler handler);
+void event_post(unsigned char flag);         // from an ISR or the main loop
+void event_eeprom(void);                     // post C_Eeprom once the EEPROM is ready
+void event_button(void);                     // every ms (ISR of Timer2): button released?
+void event_dispatch(void);                   // handle the most urgent event (or sleep first)
@@ -71,6 +71,12 @@
 // PORTB:
 // Goes to flat cable connector
 // Can be used for additional output, for example LCD display, LEDs or relais
+#define POWER_SENSE     3       // AIN1: input, divider from the unregulated supply (see relays.c)
+                                // the internal bandgap (1.23V) is used as reference
+#define SR_OE           1       // output, /OE of the 74HC595 chain (see sr.c; SR_BLOCKS > 0)
+#define SR_LATCH        4       // output, RCLK of the chain (SS, must be an output for SPI)
+#define SR_MOSI         5       // output, SER of the first register
+#define SR_SCK          7       // output, SRCLK of the chain
 
 // PORTC:
 // Used for the first set of eight relays (connections at side of the LED)
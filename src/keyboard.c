@@ -19,7 +19,7 @@
 //------------------------------------------------------------------------
 //
 // purpose:   flexible general purpose decoder for dcc
-//            here: keyboard, just a dump port input
+//            here: keyboard, local push buttons on PORTB (flat cable)
 //
 // content:   A DCC-Decoder for ATmega8515 and other AVR
 //
@@ -42,8 +42,10 @@
 #include <avr/interrupt.h>
 #include <string.h>
 
-#include "config.h"             // uses timerval
+#include "config.h"
 #include "hardware.h"
+#include "timer2.h"             // sampling on the timer wheel
+#include "events.h"             // tell the main loop
 
 
 #ifndef KEYBOARD_ENABLED 
@@ -62,16 +64,16 @@
 
 //---------------------------------------------------------------------
 // Timing Definitions:
-// (all values given in us)
 
-#define TICK_PERIOD       20000L    // 20ms tick for Timing Engine
+#define KEY_SAMPLE        5         // ms between two samples of the keys; a change is
+                                    // accepted after four equal samples (15-20 ms)
                                     
 
 //------------------------------------------------------------------------------
 // internal, but static:
 
 #ifndef KEY_PORT
-#define KEY_PORT           PINA         // This is the port where we read bits
+#define KEY_PORT           PINB         // This is the port where we read bits (flat cable)
 #endif
 
 #ifndef KEY_MASK
@@ -87,25 +89,86 @@
 #define KEY_ACTIVE_TO_GND  TRUE         // TRUE: detect a keystroke if pin is grounded
                                         // FALSE: detect a keystroke if high is applied
 
-unsigned char key_state;                // static - save the previous state of keys.
-
-unsigned char debounce;                 // static - save a flag for "current in debounce"
+#if (SR_BLOCKS > 0)
+  #if (KEY_MASK & ((1<<SR_OE) | (1<<SR_LATCH) | (1<<SR_MOSI) | (1<<SR_SCK)))
+    #error KEY_MASK uses pins of the shift registers
+  #endif
+#endif
 
-signed char last_key_time;              // last timerval
+// The keys are debounced all eight at once, with vertical counters: bit i of KeyCnt0 and
+// KeyCnt1 form a 2 bit counter for key i. The counter of a key is reset while its sample
+// equals the debounced state, and counts every sample that differs; after four such samples
+// in a row the debounced state of the key changes. So a complete sample takes a few
+// instructions, however many keys change.
+unsigned char key_state;                // debounced state, 1: pressed
+unsigned char KeyCnt0;                  // bit 0 of the vertical counters
+unsigned char KeyCnt1;                  // bit 1 of the vertical counters
+volatile unsigned char KeyPressed;      // keys pressed since the last keyboard_pressed()
+volatile unsigned char KeyReleased;     // keys released since the last keyboard_released()
 
 //------------------------------------------------------------------------------
 // code:
 
+void key_sample(unsigned char id)
+  { // timer handler (T2_TimerRun), every KEY_SAMPLE ms
+    unsigned char keys, changed;
+
+    #if (KEY_ACTIVE_TO_GND == TRUE)
+        keys = ~KEY_PORT & KEY_MASK;  
+    #else
+        keys = KEY_PORT & KEY_MASK;  
+    #endif
+    changed = keys ^ key_state;
+    KeyCnt0 = ~(KeyCnt0 & changed);             // count (or reset if unchanged)
+    KeyCnt1 = KeyCnt0 ^ (KeyCnt1 & changed);
+    changed &= KeyCnt0 & KeyCnt1;               // counted four times: accept
+    key_state ^= changed;
+    KeyPressed |= key_state & changed;
+    KeyReleased |= ~key_state & changed;
+    if (key_state & changed) event_post(C_Keys);
+    T2_TimerStart(T2_TIMER_KEYS, KEY_SAMPLE);
+  }
+
+
 void init_keyboard(void)
   {
-    debounce = 0;
+    key_state = 0;
+    KeyCnt0 = 0xFF;
+    KeyCnt1 = 0xFF;
+    KeyPressed = 0;
+    KeyReleased = 0;
+    if (KEY_MASK == 0) return;                  // no keys: no sampling
+    DDRB &= ~KEY_MASK;                          // inputs (note: KEY_PORT is PINB)
     #if (KEY_ACTIVE_TO_GND == TRUE)
-        key_state = ~KEY_PORT;  
+        PORTB |= KEY_MASK;                      // pull-ups
+        key_state = ~KEY_PORT & KEY_MASK;  
     #else
-        key_state = KEY_PORT;  
+        key_state = KEY_PORT & KEY_MASK;  
     #endif
+    T2_TimerHandler(T2_TIMER_KEYS, key_sample);
+    T2_TimerStart(T2_TIMER_KEYS, KEY_SAMPLE);
+  }
+
+
+unsigned char keyboard_pressed(void)
+  { // returns the keys pressed since the last call (bit i: KEY_PORT, bit i)
+    unsigned char keys;
+    cli();
+    keys = KeyPressed;
+    KeyPressed = 0;
+    sei();
+    return(keys);
+  }
+
 
-    last_key_time = timerval;                    // remember time 
+unsigned char keyboard_released(void)
+  { // returns the keys released since the last call
+    unsigned char keys;
+    cli();
+    keys = KeyReleased;
+    KeyReleased = 0;
+    sei();
+    return(keys);
   }
 
 
@@ -117,50 +180,23 @@ void init_keyboard(void)
 //    ....
 //    7: Port (KEY_PORT), bit 7
 // 0xff: no keystroke detected
+// If more keys were pressed, the others are returned by the next calls.
 //
 unsigned char keyboard_poll(void)
   {
-    unsigned char keys, xor;
+    unsigned char i, mask;
 
-    if ((char)(timerval - last_key_time) < 1)  return(0xFF);
-
-    last_key_time++;
-
-    #if (KEY_ACTIVE_TO_GND == TRUE)
-        keys = ~KEY_PORT;  
-    #else
-        keys = KEY_PORT;  
-    #endif
-    xor = keys ^ key_state;
-    xor = xor & KEY_MASK;
-
-    if (xor)
-      {                         // something has changed
-        unsigned char i, mask;
-
-        mask = 1;
-        for (i=0; i<8; i++)
+    mask = 1;
+    for (i=0; i<8; i++)
+      {
+        if (KeyPressed & mask)
           {
-            if (xor & mask)
-              {
-                if (debounce & mask)
-                  { // debounce over, now change state and report
-                    debounce &= ~mask;
-                    key_state ^= mask;
-
-                    if (keys & mask) return(i);
-                  }
-                else
-                  { 
-                    debounce |= mask;
-                  }
-              }
-            mask = mask << 1;           
+            cli();
+            KeyPressed &= ~mask;
+            sei();
+            return(i);
           }
-      }
-    else
-      {
-        debounce = 0;
+        mask = mask << 1;           
       }
     return(0xFF);
   }
@@ -193,13 +229,9 @@ void keytest(void)
 
     while(1)
       {
+        key_sample(T2_TIMER_KEYS);
         code = keyboard();
         PORTB = code;
-        code = keyboard();
-        PORTB = code;
-        code = keyboard();
-        PORTB = code;
-        timerval++;
       }
   }
 #endif
@@ -32,6 +32,10 @@ void init_keyboard(void);
 
 unsigned char keyboard(void);
 
+unsigned char keyboard_pressed(void);           // keys pressed since the last call (mask)
+
+unsigned char keyboard_released(void);          // keys released since the last call (mask)
+
 //--------------------------------------------------------------------------------------
 
 void keytest(void);
@@ -45,9 +45,10 @@
 #include "timer_led.h"           // LED control
 #include "keyboard.h"            // button control
 #include "timer2.h"              // timer used for relays in round-robin fashion
+#include "bam.h"                 // dimming of the outputs
+#include "sr.h"                  // additional relays via shift registers
 #include "relays.h"              // handling of relays
-
-#include "relays.h"              // handling of relays
+#include "events.h"              // main loop
 
 #include "main.h"
 
@@ -74,90 +75,205 @@ void init_main(void)
           | (0<<PROGTASTER)     // input    
           | (1<<DCC_ACK);       // output, sending 1 makes an ACK
     
+    PORTA = 0;                  // output: all off (set before the pins become outputs)
+  #if (SR_BLOCKS > 0)
+    PORTB = (1<<SR_OE);         // output: all off, /OE high: shift registers disabled (sr.c)
+  #else
+    PORTB = 0;                  // output: all off
+  #endif
+    PORTC = 0;                  // output: all off
+
     DDRA  = 0xFF;               // PORTA: All Bits as Output
     DDRB  = 0xFF;               // PortB: All Bits as Output
     DDRC  = 0xFF;               // PORTC: All Bits as Output
-       
-    PORTA = 0;                  // output: all off
-    PORTB = 0;                  // output: all off     
-    PORTC = 0;                  // output: all off
   }
   
 
 
 //------------------------------------------------------------------------
-// This Routine is called when PROG is pressed
+// Program button
 // -- manual programming and accordingly setting of CV's
 //
-#define DEBOUNCE  (50000L / TICK_PERIOD)
-#if (DEBOUNCE == 0)
- #define DEBOUNCE  1
-#endif
+// After the button has been pressed and released, the next accessory command (of any address)
+// becomes the address of the decoder; its direction becomes CV Ract and its output pair the
+// mode. Pressing the button again (LED off) cancels. The button is handled by a state machine,
+// so the relays and the other packets are handled as usual meanwhile. DoProgramming is called
+// for C_Button: by events.c when the button is pressed, and by the button timer (T2_TIMER_PROG)
+// every DEBOUNCE ms while the state machine samples the button.
+//
+#define DEBOUNCE  50                                    // ms
+
+#define PROG_IDLE       0                               // waiting for a press
+#define PROG_PRESS      1                               // press seen, debouncing
+#define PROG_HELD       2                               // pressed (LED on), wait for the release
+#define PROG_RELEASE    3                               // released, debouncing
+#define PROG_LEARN      4                               // waiting for the command to learn
+#define PROG_CANCEL     5                               // pressed again (LED off), wait for the release
+
+unsigned char ProgState;                                // PROG_IDLE ... PROG_CANCEL
+volatile unsigned char ProgSample;                      // 1: the button timer has run out
+
+
+void prog_timer(unsigned char id)
+  {
+    ProgSample = 1;                                     // (called by T2_TimerRun)
+    event_post(C_Button);
+  }
+
+
+void prog_wait(unsigned char state)
+  {
+    ProgState = state;
+    T2_TimerStart(T2_TIMER_PROG, DEBOUNCE);
+  }
 
 
 void DoProgramming(void)
   {
-    signed char my_timerval, myCommand, myMode;
+    unsigned char sample;
+
+    cli();
+    sample = ProgSample;
+    ProgSample = 0;
+    sei();
+    switch (ProgState)
+      {
+        case PROG_IDLE:
+          prog_wait(PROG_PRESS);
+          break;
+        case PROG_LEARN:
+          if (!sample)                                  // pressed: cancel
+            {
+              turn_led_off();
+              prog_wait(PROG_CANCEL);
+            }
+          break;
+        default:                                        // the other states sample the button
+          if (!sample) break;                           // (ignore bounces)
+          if (ProgState == PROG_PRESS)
+            {
+              if (PROG_PRESSED)                         // still pressed?
+                {
+                  turn_led_on();
+                  prog_wait(PROG_HELD);
+                }
+              else ProgState = PROG_IDLE;
+            }
+          else if (ProgState == PROG_RELEASE) ProgState = PROG_LEARN;
+          else if (PROG_PRESSED) prog_wait(ProgState);  // held: wait for the release
+          else if (ProgState == PROG_HELD) prog_wait(PROG_RELEASE);
+          else ProgState = PROG_IDLE;                   // PROG_CANCEL: done
+          break;
+      }
+  }
+
+
+void prog_learn(void)
+  {
+    unsigned char myCommand, myMode;
+
+    // write the address in EEPROM
+    my_eeprom_write_byte(&CV.myAddrL, (unsigned char) ReceivedAddr & 0b00111111  );     
+    my_eeprom_write_byte(&CV.myAddrH, (unsigned char) (ReceivedAddr >> 6) & 0b00000111);
+    // write the relays activate command in EEPROM. LH100 "-": 0 / "+": 1
+    my_eeprom_write_byte(&CV.Ract, (unsigned char) ReceivedCommand & 0b00000001);
+    // write the decoder mode in EEPROM (see relays.c for description of modes)
+    myCommand = ReceivedCommand & 0b00000111;
+    myMode = myCommand >> 1;
+    my_eeprom_write_byte(&CV.Mode, myMode);                       
+    // wait for write to complete
+    do {} while (!eeprom_is_ready());
+    
+    LED_OFF;
 
-    my_timerval = timerval;
-    while(timerval - my_timerval < DEBOUNCE) ;          // wait
+    // we got reprogrammed ->
+    // forget everthing running and restart decoder!                    
+    _restart();
+  }
 
-    if (PROG_PRESSED)                                   // still pressed?
+
+//--------------------------------------------------------------------------------------------
+// Event handlers (see events.c)
+//--------------------------------------------------------------------------------------------
+// After each event main_rearm() lets Timer2 post C_Tick at the earliest deadline of the
+// relays tasks, and posts C_Save if a record can be saved.
+#define IDLE_MAX  1000                                  // ms, longest sleep without a deadline
+
+void ev_packet(void)
+  {
+    unsigned char myResult;
+
+    myResult = analyze_message(&incoming);
+    if ((ProgState == PROG_LEARN) && (myResult > 0) && (myResult != 4) && (myResult != 6))
+      {
+        prog_learn();                                   // any accessory command: learn it
+      }
+    switch (myResult)
+      {
+        case 2:                                         // MyAddr received
+        case 3:                                         // greater than MyAddr received
+          relays_actions(ReceivedCommand);
+          break;
+        case 4:                                         // binary state for our loco address
+          relays_binary_state(ReceivedBinState, ReceivedActivate);
+          break;
+        case 5:                                         // alias (group) address
+          relays_alias(ReceivedAlias, ReceivedCommand & 0b00000001);
+          break;
+        case 6:                                         // analog function for our loco address
+          relays_analog(ReceivedAnalog, ReceivedLevel);
+          break;
+      }
+    semaphor_get(C_Received);                           // now take away the protection
+  }
+
+
+void ev_keys(void)                                      // local buttons toggle relays
+  {
+    unsigned char pressed, i;
+
+    pressed = keyboard_pressed();
+    for (i=0; i<8; i++)
       {
-        turn_led_on();
-        
-        while(PROG_PRESSED) ;                           // wait for release
-
-        my_timerval = timerval;
-        while(timerval - my_timerval < DEBOUNCE) ;      // wait
-        
-        while(!PROG_PRESSED)
-          {
-            if (semaphor_get(C_Received))
-              {                                         // Message
-                if (analyze_message(&incoming))         // yes, any accessory
-                  {
-                    // write the address in EEPROM
-                    my_eeprom_write_byte(&CV.myAddrL, (unsigned char) ReceivedAddr & 0b00111111  );     
-                    my_eeprom_write_byte(&CV.myAddrH, (unsigned char) (ReceivedAddr >> 6) & 0b00000111);
-                    // write the relays activate command in EEPROM. LH100 "-": 0 / "+": 1
-                    my_eeprom_write_byte(&CV.Ract, (unsigned char) ReceivedCommand & 0b00000001);
-                    // write the decoder mode in EEPROM (see relays.c for description of modes)
-                    myCommand = ReceivedCommand & 0b00000111;
-                    myMode = myCommand >> 1;
-                    my_eeprom_write_byte(&CV.Mode, myMode);                       
-                    // wait for write to complete
-                    do {} while (!eeprom_is_ready());
-                    
-                    LED_OFF;
-
-                    // we got reprogrammed ->
-                    // forget everthing running and restart decoder!                    
-                    
-                    cli();
-                    
-                    // laut diversen Internetseiten sollte folgender Code laufen -
-                    // tuts aber nicht, wenn man das Assemblerlistung ansieht.
-                    // void (*funcptr)( void ) = 0x0000;    // Set up function pointer
-                    // funcptr();                        // Jump to Reset vector 0x0000
-                    
-                    __asm__ __volatile 
-                    (
-                       "ldi r30,0"  "\n\t"
-                       "ldi r31,0"  "\n\t"
-                       "icall" "\n\t"
-                     );
-                    
-                    // return;  
-                  }
-              }
-          }  // while
-        turn_led_off();
-        my_timerval = timerval;
-        while(timerval - my_timerval < DEBOUNCE) ;     // wait    
-        while(PROG_PRESSED) ;       // wait for release
+        if (pressed & (1<<i)) relays_toggle(KEY_RELAY - 1 + i);
       }
-    return;   
+  }
+
+
+void ev_cv_written(void)                                // a CV was changed (PoM)
+  {
+    relays_read_cvs();
+    bam_read_cvs();
+  }
+
+
+void ev_tick(void)
+  {
+    T2_TimerRun();                                      // handlers of the expired timers
+    relays_round_robin();                               // check if the relays should be changed
+    relays_sequencer();                                 // run the sequence program (if any)
+    relays_schedule();                                  // set relays that had to wait (inrush)
+    relays_pulse();                                     // release relays at the end of a pulse
+  }
+
+
+void ev_save(void)
+  {
+    relays_save();                                      // save the relay state (lazily)
+    relays_count_save();                                // save the switching cycles (lazily)
+  }
+
+
+void main_rearm(void)
+  {
+    unsigned long now, due;
+    now = T2_Now();
+    due = now + IDLE_MAX;
+    relays_next_due(now, &due);
+    if ((long)(due - now) <= 0) event_post(C_Tick);     // (the sequencer continues at once)
+    else T2_WakeAt(due);
+    if (relays_save_ready()) event_post(C_Save);
+    else if (relays_save_busy()) event_eeprom();        // continue when the EEPROM is ready
   }
 
 
@@ -165,11 +281,13 @@ void DoProgramming(void)
 int main(void)
   {
     init_main();                                        // setup hardware ports (to do!!)
-    init_timer1();                                      // setup timer for LeD
-    init_timer2();                                      // setup timer for relays (mode 3)
+    init_timer2();                                      // setup timer for relays and timer wheel
+    init_timer_led();                                   // LED (on the timer wheel)
+    init_bam();                                         // dimming of the outputs (Timer1)
+    init_sr();                                          // additional relays (SR_BLOCKS)
     init_dcc_receiver();                                // setup dcc receiver
     init_dcc_decode();                                  // setup dcc decoder
-    init_keyboard();                                    // local tracers
+    init_keyboard();                                    // local buttons (KEY_MASK)
     init_relays_actions();                              // relays related setup
 
     if (my_eeprom_read_byte(&CV.myAddrH) & 0x80)        // Check if address has been programmed
@@ -177,6 +295,15 @@ int main(void)
         flash_led_fast(5);                              // warning - we are unprogrammed
       }
 
+    init_events();                                      // main loop (idle sleep)
+    event_handler(C_Received,  ev_packet);
+    event_handler(C_Button,    DoProgramming);
+    T2_TimerHandler(T2_TIMER_PROG, prog_timer);
+    event_handler(C_Keys,      ev_keys);
+    event_handler(C_CvWritten, ev_cv_written);
+    event_handler(C_Tick,      ev_tick);
+    event_handler(C_Eeprom,    ev_save);
+    event_handler(C_Save,      ev_save);
     sei();                                              // Global enable interrupts
 
     // Check if the EEPROM has been initialised. In case the program is compiled
@@ -190,18 +317,11 @@ int main(void)
     
     
     
+    main_rearm();
     while(1)
       {
-        if (semaphor_query(C_Received))
-          {
-            if (analyze_message(&incoming) >= 2)        // MyAddr or greater received
-              {
-                relays_actions(ReceivedCommand);
-              }
-            semaphor_get(C_Received);                   // now take away the protection
-          }
-        if (PROG_PRESSED) DoProgramming();
-        relays_round_robin();                           // check if the relays should be changed
+        event_dispatch();                               // the most urgent event (or sleep)
+        main_rearm();                                   // next deadline of the relays tasks
       }
   }
 
@@ -0,0 +1,55 @@
+//------------------------------------------------------------------------
+//
+// file:      output.h
+//
+// purpose:   Output drivers of relays.c, selected at compile time
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at http://www.gnu.org/licenses/gpl.txt
+//
+//------------------------------------------------------------------------
+//
+// relays.c only works on its shadow patterns and reaches the outputs via the functions below:
+// - on the decoder: relays 1-16 via bam.c (PORTA / PORTC), relays 17 and up via sr.c. The
+//   functions are inline wrappers, so they cost nothing compared with calling these directly.
+// - with OUTPUT_HOST defined: the recording driver of output_host.c, which logs every write
+//   with the virtual time T2_Millis. This allows to run relays.c on a PC.
+//
+//------------------------------------------------------------------------
+#if defined OUTPUT_HOST
+
+#include <stdio.h>
+
+extern FILE *OutLog;                         // log of the writes (NULL: stdout)
+extern volatile unsigned char OutA;          // Outputs of PORTA that are switched on
+extern volatile unsigned char OutC;          // Outputs of PORTC that are switched on
+#if (SR_BLOCKS > 0)
+extern unsigned char SR_Shadow[SR_BLOCKS];   // relays 17-24 (bit 0 = relay 17), 25-32, ...
+#endif
+
+void out_write_A(unsigned char value);       // relays 9-16 (PORTA order)
+void out_write_C(unsigned char value);       // relays 1-8
+void out_write_sr(void);                     // relays 17 and up (SR_Shadow)
+void out_set_level(unsigned char output, unsigned char level);  // output 0..15
+void out_off(void);                          // all relays off at once (supply drops)
+
+#else
+
+#include "bam.h"
+#include "sr.h"
+
+static inline void out_write_A(unsigned char value) {bam_write_A(value);}
+static inline void out_write_C(unsigned char value) {bam_write_C(value);}
+static inline void out_write_sr(void) {sr_update();}
+static inline void out_set_level(unsigned char output, unsigned char level)
+  {bam_set_level(output, level);}
+static inline void out_off(void)
+  {
+  PORTA = 0;
+  PORTC = 0;
+  #if (SR_BLOCKS > 0)
+  PORTB |= (1<<SR_OE);
+  #endif
+  }
+
+#endif
@@ -0,0 +1,88 @@
+//------------------------------------------------------------------------
+//
+// file:      output_host.c
+//
+// purpose:   Recording output driver, to run relays.c on a PC (see output.h)
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at http://www.gnu.org/licenses/gpl.txt
+//
+//------------------------------------------------------------------------
+//
+// Only used if OUTPUT_HOST is defined; not part of the decoder firmware (see Makefile).
+// It is linked instead of bam.c and sr.c, with relays.c, timer2.c and config.c, a main
+// program that calls the relays functions and the Timer2 ISR (one call = 1 ms of virtual
+// time), and stand-ins for the avr-libc headers: see test/host and make host-test.
+// Every write to the outputs is logged as one line, on stdout or on the file OutLog:
+//   <T2_Millis> <A|C|S|L|X> <value(s)>
+// A = relays 9-16 (PORTA order), C = relays 1-8, S = shift registers (first register first),
+// L = level of an output, X = all off. Identical runs give identical logs, so the log of a
+// run can be compared with a reference log.
+//
+//------------------------------------------------------------------------
+
+#if defined OUTPUT_HOST
+
+#include <stdio.h>
+#include <avr/pgmspace.h>
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+
+#include "config.h"              // general definitions the decoder, cv's
+#include "timer2.h"
+#include "output.h"
+
+FILE *OutLog;                    // where the writes are logged (NULL: stdout)
+volatile unsigned char OutA;     // outputs of PORTA that are switched on
+volatile unsigned char OutC;     // same, but now for PORTC
+#if (SR_BLOCKS > 0)
+unsigned char SR_Shadow[SR_BLOCKS];
+#endif
+
+
+static FILE *out_log(void)
+{
+  return OutLog ? OutLog : stdout;
+}
+
+
+void out_write_A(unsigned char value)
+{
+  OutA = value;
+  fprintf(out_log(), "%lu A %02X\n", T2_Millis, value);
+}
+
+
+void out_write_C(unsigned char value)
+{
+  OutC = value;
+  fprintf(out_log(), "%lu C %02X\n", T2_Millis, value);
+}
+
+
+void out_write_sr(void)
+{
+  #if (SR_BLOCKS > 0)
+  unsigned char i;
+  fprintf(out_log(), "%lu S", T2_Millis);
+  for (i=0; i < SR_BLOCKS; i++) {fprintf(out_log(), " %02X", SR_Shadow[i]);}
+  fprintf(out_log(), "\n");
+  #endif
+}
+
+
+void out_set_level(unsigned char output, unsigned char level)
+{
+  fprintf(out_log(), "%lu L %u %u\n", T2_Millis, output, level);
+}
+
+
+void out_off(void)
+{
+  OutA = 0;
+  OutC = 0;
+  fprintf(out_log(), "%lu X\n", T2_Millis);
+}
+
+#endif
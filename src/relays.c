@@ -16,7 +16,7 @@
 //
 // A DCC Relays Decoder for ATmega16A and other AVR.
 // Two blocks of each eight relays can be switched; the two blocks are independent from each other
-// (although the mode is used for both blocks).
+// and may each have their own mode (see "Modes per block" below).
 // The application that was in mind while designing this decoder, was to control a number of video
 // camera modules with standard video signal, such as sold for example by Conrad for 30 Euros.
 //
@@ -36,13 +36,32 @@
 //    - note: unlike the previous modes, other relays will not be released after one relays is set
 //    - note: unlike the previous modes, multiple relays may be closed at the same time
 // 3: Relays are closed in a round-robin fashion
-//    - the time (in seconds) each relays is closed is determined by CV535 (RInter)
+//    - the time each relays is closed is determined by CV535 (RInter), unless a relay has its
+//      own time in CV612-CV627 (relays 1-16; 0 = use RInter)
+//    - these times are in units of CV628 (RTick) x 10 ms. The default (100) gives seconds.
+//    - both blocks follow their own schedule: the next switch moment (deadline, in ms) is
+//      the previous deadline plus the time of the new relay, so no drift accumulates
 //    - since some of the relays may not be used, the relays that need to be involved in this
 //      round-robin schema are defined by CV533 (relays 1-8) and CV534 (relays 9-16).
 //      Each bit in these CVs represent one relay. If CV533=3, only relays 1 and 2 are used,
 //      if CV533=5, only relais 1 and 3 are used, if CV535=255, relays 1-8 are used.
 // Setting the mode can be controlled at programming time (mode = address - base_address)
 // or via CV536.
+//
+// Modes per block:
+// CV872 (relays 1-8) and CV873 (relays 9-16) give a block its own mode (0..3); 255 (default)
+// means that the block uses CV536. In mode 0 round-robin is started by the DEACTIVATE command
+// for the last decoder address, and only blocks in mode 0 join; blocks in mode 3 always run.
+//
+// Mutual-exclusion groups:
+// Up to four groups of relays can be defined in CV874-CV881 (2 CVs per group: a mask for
+// relays 1-8 and a mask for relays 9-16). Setting a relay releases the other relays of all
+// groups it belongs to, also if they are in the other block, whatever the mode of that block.
+// The groups are kept in RAM as pairs of port masks, so a command only needs mask arithmetic
+// on the shadow patterns to release its block (modes 0 and 1) and its groups. The mode of each
+// block is resolved once into a handler function (action_modeX), so relays_actions itself
+// does not test the mode.
+//
 // Setting the ACTIVATE command can be controlled at programming time or via CV532.
 // At programming time, the ACTIVE command is the "+" or "-" on the LH100
 //
@@ -65,6 +84,119 @@
 //             6                2           1
 // Note that, while programming, pressing "+" or "-" gives the same address (although with a
 // different ACTIVATE command. 
+//
+// Binary states:
+// In addition to the 16 accessory addresses, relays can be controlled via the Binary State
+// Control Instructions (RP-9.2.1, short and long form) sent to a multifunction address
+// (CV551 / CV552; CV551=0 disables this). Up to four ranges of binary state numbers (1..32767)
+// can be mapped onto the relays via CV553-CV568; each range uses 4 CVs:
+//   First binary state number (low, high), number of states (0 = not used), first relay (1..16)
+// Binary state "on" acts as the ACTIVATE command, "off" as the DEACTIVATE command, thus the
+// selected mode applies as well. Broadcast (binary state 0) is ignored.
+//
+// Alias (group) addresses:
+// Besides its own addresses, the decoder listens to up to eight secondary accessory addresses
+// (CV569-CV608), for example to let one command switch "all cameras to monitor 1" on many
+// decoders. Each entry uses 5 CVs: the output address (low, high; NMRA output address method),
+// a mask for relays 1-8, a mask for relays 9-16 and the operation:
+//   1: ACTIVATE sets the relays in the mask, DEACTIVATE releases them
+//   2: ACTIVATE releases all relays in the blocks touched by the mask, then sets the masked
+//      relays (as mode 0); DEACTIVATE is ignored
+//   3: ACTIVATE releases the relays in the mask
+//   4: ACTIVATE starts a sequence program (see below) at offset "mask for relays 1-8";
+//      DEACTIVATE stops it
+// Alias addresses should not overlap with the decoder's own addresses. As for these, the
+// repetitions of a command by the command station are ignored, so that a sequence program is
+// not restarted by the packets that started it; a local button makes the next command new.
+//
+// Sequencer:
+// Small relay programs are stored in the sequence area (CV629-CV692) and run without further
+// DCC traffic once started via an alias address. Instructions (offsets are relative to CV629):
+//   0                         end of the program; the relays stay as they are
+//   1, relays 1-8, relays 9-16, time   set exactly these relays, then wait time x CV628 x 10 ms
+//   2, offset, count          jump back to offset; the part in between runs count times
+//                             (0 = forever). Loops can be nested two deep.
+// Example: 1,1,0,50, 1,2,0,50, 2,0,10, 0 switches relays 1 and 2 alternately 10 times.
+// Starting a program stops round-robin (blocks in mode 3 continue when it ends). The program is
+// executed from the main loop, with at most SEQ_OPS instructions per pass, so it never delays
+// the processing of DCC packets. Its timing is drift-free, like round-robin: each wait starts
+// at the end of the previous one.
+//
+// Outputs:
+// All actions modify a RAM copy (shadow) of PORTA and PORTC; the new pattern is written to each
+// port with a single write (relays_commit). Therefore there is no intermediate moment in which
+// no relay, or the wrong relay, is energized. The writes go via the output driver (output.h):
+// on the decoder bam.c (which may dim the outputs) and sr.c; on a PC a recording driver, so
+// all relay modes can be run and their output compared with a reference log.
+// Releasing relays is done at once. Setting relays is done by a small scheduler, to limit the
+// inrush current if many relays have to be set at the same moment: per time slice (CV611, in ms)
+// at most CV610 relays are set (0 = no limit); the remaining relays follow in the next slices.
+// The relays to be set are queued in the order of the commands; relays that are released by a
+// newer command before their turn came are dropped from the queue.
+// If a break-before-make time is set (CV609, in ms), relays are only set once this time has
+// passed since the last release.
+//
+// Additional relays:
+// With SR_BLOCKS (config.h) shift registers on PORTB, relays 17 up to 64 follow relay 16 on
+// the next decoder addresses (see sr.c). They use the mode of CV536 per register of eight
+// relays (mode 3 acts as mode 2); round-robin, groups, pulses, dimming and the state log only
+// apply to relays 1-16.
+//
+// Dimming:
+// Each output has a level (CV696-CV711, 255 = full on), see bam.c. The level can also be
+// changed via the Analog Function Group instruction (RP-9.2.1) sent to the binary state address
+// (CV551 / CV552): analog function output 1..16 sets the level of relay 1..16 until the next
+// power-up. A relay that is switched off stays off, whatever its level.
+//
+// Relay state:
+// If CV544 (LastState) is 1, the relay state is saved in a ring log of 32 records (CV712-CV871)
+// and restored at power-up (by init_relays_actions, within a few ms). A record holds both relay
+// patterns, the mode, whether round-robin is active and the round-robin position. Saving is
+// lazy: STATE_DELAY after the last command (C_DoSave), one EEPROM byte per pass of the main
+// loop, and only if the state differs from the last record. Round-robin steps do not cause a
+// save by themselves; relays in pulse mode are never saved, a running sequence program neither.
+// Endurance: each save writes one 5 byte record, the next save the next record. With 100.000
+// write cycles per EEPROM cell, the log lasts 32 x 100.000 = 3.2 million saves. Since saves are
+// at least STATE_DELAY (2 s) apart, this is more than 70 days of changes every 2 seconds, or
+// more than 80 years with 100 changes per day.
+// If CV544 is 2, the state is kept in RAM only and saved when the supply drops. This requires
+// a voltage divider from the unregulated supply to AIN1 (PB3, POWER_SENSE), giving about 1.5V
+// at the normal supply voltage, and enough capacitance behind the 5V regulator. The analog
+// comparator compares AIN1 with the internal bandgap; once AIN1 drops below it, its ISR first
+// checks that AIN1 stays below for AC_SAMPLES x AC_SAMPLE us (100 us), so that a short dip
+// (noise, the inrush current of relays) is ignored. Then it releases all relays (to reduce the
+// current), and writes the record into the next slot of the log, which was erased beforehand
+// (armed). On the ATmega164A/324A/644P the EEPROM then only needs to write, not erase:
+// 5 x 1.8 ms. The ATmega8535/16/32 cannot split erase and write, so there the record takes
+// 5 x 8.5 ms; the capacitors should hold the supply for this time (plus the 100 us).
+// If the supply recovers, the decoder restarts (and restores the saved state).
+// A change of CV544 takes effect at the next power-up.
+//
+// Switching cycles:
+// Each time a relay is set, its counter is incremented: at the moment the scheduler writes the
+// port, the relays that are set are counted as one bit pattern per block in bit-sliced counters
+// (CNT_PLANES bit planes in RAM), so counting costs the same for one or eight relays. Once per
+// hour (CNT_FLUSH), or earlier if a counter is halfway full but not within CNT_GAP (20 minutes)
+// after the last flush, the counts are added to the totals in EEPROM (from CV886 on). The
+// records form a ring over the rest of the EEPROM (2, 13 or 34 records, see cv_define.h); each
+// flush writes the next record, byte by byte in the main loop, and its sequence number last.
+// A full counter (65535) stays at its maximum; at 50 cycles per second (round-robin with CV628
+// = 1, every 20 ms) a counter takes 21 minutes to fill up, so no cycles are lost before the
+// flush. Endurance: a cell is written at most once per CNT_GAP per record, i.e. worst case
+// 100.000 x 2 x 20 minutes = 7.6 years of round-robin at the highest speed with 512 bytes of
+// EEPROM (50 years with 1K); normally (one flush per hour) more than 20 years. At most the
+// cycles of the last hour are lost at power down. To read the total (24 bits) of a relay,
+// write its number (1..16) to CV882 and read CV883 (low), CV884 and CV885 (high).
+// Counting is left out if CYCLE_COUNT (config.h) is FALSE, by default on the ATmega8535 with its
+// 512 bytes of SRAM; CV883-CV885 then read 0.
+//
+// Pulse mode:
+// Relays selected in CV693 (relays 1-8) and CV694 (relays 9-16) are released automatically
+// after the time in CV695 (x 10 ms), for latching relays or door strikes. The pulse starts at
+// the moment the relay is actually set (so after a possible inrush delay). Each relay has its
+// own timer on the timer wheel of timer2.c; when it expires its handler only flags the end of
+// the pulse, and relays_pulse releases the relay. Starting a pulse takes a constant time; the
+// Timer2 ISR only marks the slot of the wheel, however many pulses end at the same moment.
 //------------------------------------------------------------------------------------------------
 
 #include <stdlib.h>
@@ -81,6 +213,7 @@
 #include "hardware.h"
 #include "dcc_receiver.h"
 #include "timer2.h"
+#include "output.h"         // bam.c and sr.c, or the host driver
 #include "main.h"
 #include "relays.h"
 
@@ -88,125 +221,954 @@
 // 1. Global variables
 //================================================================================================
 unsigned char mode;              // the mode in which this decoder operates (see above - CV536)
+unsigned char ModeA;             // mode of relays 9-16 (CV873, else CV536)
+unsigned char ModeC;             // mode of relays 1-8 (CV872, else CV536)
+unsigned char GroupA[GROUPS];    // mutual-exclusion groups (CV874-CV881): relays of PORTA
+unsigned char GroupC[GROUPS];    // same, but now for PORTC
+const unsigned char BitA[16] PROGMEM =   // per relay: its bit in PORTA (0 for relays 1-8)
+  {0, 0, 0, 0, 0, 0, 0, 0, 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01};
+const unsigned char BitC[16] PROGMEM =   // per relay: its bit in PORTC (0 for relays 9-16)
+  {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0, 0, 0, 0, 0, 0, 0, 0};
+#define RELAYS (16 + 8 * SR_BLOCKS)   // relays 17 and up are on the shift registers (sr.c)
+typedef void (*t_action)(unsigned char relay, unsigned char activate);
+t_action Action[RELAYS / 8];     // handler per block (relays 1-8, 9-16, ...), selected by mode
 unsigned char RR_Interval;       // the interval used with round-robin (CV535)
 unsigned char RR_BlockA;         // round-robin relays used, relays 9-16 (CV534)
 unsigned char RR_BlockC;         // round-robin relays used, relays 1-8 (CV533)
 unsigned char relaisActiveCmd;   // 0: relais active with - / 1: relais active with + (CV532)
+unsigned char RR_Break;          // break-before-make time in ms (CV609)
+
+unsigned char RR_MaxOn;          // max. number of relays set per time slice (CV610)
+unsigned char RR_Slice;          // time slice in ms (CV611)
+
+unsigned char ShadowA;           // the relays pattern for PORTA, written by relays_commit()
+unsigned char ShadowC;           // same, but now for PORTC
+
+#define SCHED_QUEUE 4            // number of commits that may wait for the scheduler
+unsigned char SchedA[SCHED_QUEUE];  // relays (PORTA) still to be set, oldest commit first
+unsigned char SchedC[SCHED_QUEUE];  // same, but now for PORTC
+unsigned char SchedCount;        // number of queue entries in use
+unsigned long SchedSliceEnd;     // end of the current time slice (T2_Millis)
+unsigned char SchedBudget;       // relays that may still be set in the current time slice
+unsigned long SchedBreakEnd;     // end of break-before-make after the last release (T2_Millis)
+unsigned char SchedBreak;        // 1: wait for break-before-make before setting relays
 
 unsigned char PreviousCommand;   // the command that has just been executed
+unsigned char PreviousAlias;     // the alias command that has just been executed (entry, operation)
 unsigned char RRMode;            // determines if the decoder is in round-robin mode
 
-unsigned char RBlockA[8];        // the relays in block A that need to be used for round-robin
-unsigned char RBlockC[8];        // same, but now for block C
-unsigned char RBlockA_Next;      // the next round-robin relay in block A     
-unsigned char RBlockC_Next;      // same, but now for block C
+unsigned char RRBitA;            // the current round-robin relay in block A (one bit set)
+unsigned char RRBitC;            // same, but now for block C
+unsigned char RRDwell[16];       // round-robin time per relay in RR_Tick (CV612-CV627)
+unsigned int  RR_Tick;           // unit of RInter and RDwell in ms (CV628 x 10)
+unsigned long RRDueA;            // next switch moment (T2_Millis) of block A
+unsigned long RRDueC;            // same, but now for block C
+
+#define STATE_DELAY 2000             // ms between the last command and saving the state
+unsigned char StateSave;             // save and restore the relay state (CV544)
+unsigned char LogSlot;               // slot of the newest record in the state log
+unsigned char LogSeq;                // sequence number of the newest record
+unsigned char LogStep;               // 0: idle, else number of the next byte to write + 1
+unsigned char LogTarget;             // slot being written
+unsigned char LogArmed;              // 1: the slot after LogSlot is erased (CV544 = 2)
+unsigned char LogRecord[sizeof(t_state_record)];  // the record being written
+unsigned long LogDue;                // moment (T2_Millis) to save the state
+
+#if (CYCLE_COUNT == TRUE)
+#define CNT_PLANES  16                   // bits of the counters in RAM (up to 65535 cycles)
+#define CNT_FLUSH   3600000UL            // ms between two flushes of the counters (1 hour)
+#define CNT_GAP     1200000UL            // ms at least between two flushes (20 minutes)
+unsigned char CntA[CNT_PLANES];          // cycles since the last flush, bit-sliced: bit k of
+                                         // the counters of relays 9-16 (PORTA order)
+unsigned char CntC[CNT_PLANES];          // same, but now for relays 1-8
+unsigned char CntSlot;                   // newest record of the cycle log
+unsigned char CntSeq;                    // its sequence number (0xFF: no record written yet)
+unsigned char CntStep;                   // 0: idle, else number of the next byte to write + 1
+unsigned long CntTotal;                  // new total of the relay being written
+unsigned long CntDue;                    // moment (T2_Millis) of the next flush
+unsigned long CntGap;                    // from this moment on a full counter forces a flush
+#endif
+
+#define SEQ_IDLE    0xFF             // SeqPC value if no program is running
+#define SEQ_OPS     4                // max. number of instructions per pass of the main loop
+#define SEQ_NESTING 2                // max. depth of nested loops
+unsigned char PulseA;                // relays in pulse mode, block A (port order, CV694)
+unsigned char PulseC;                // relays in pulse mode, block C (CV693)
+unsigned int  PulseTime;             // pulse time in ms (CV695 x 10)
+
+unsigned char SeqPC;                 // offset of the next instruction in the sequence area
+unsigned long SeqDue;                // moment (T2_Millis) at which the next instruction is due
+unsigned char SeqDepth;              // number of active (counted) loops
+unsigned char SeqLoopPC[SEQ_NESTING];   // offset of the LOOP instruction of an active loop
+unsigned char SeqLoopCnt[SEQ_NESTING];  // remaining jumps of that loop
+
+struct
+  {
+    unsigned int  first;         // first binary state number of this range
+    unsigned char count;         // number of binary states in this range (0 = not used)
+    unsigned char relay;         // relay (0..15) controlled by the first binary state
+  } BSRange[BS_RANGES];          // copy of CV553-CV568, to avoid EEPROM reads per packet
 
 
 
 //================================================================================================
 // 2. Support functions
 //================================================================================================
-void set_relay_C(unsigned char relay_no) {PORTC |= (1<<relay_no);}
-void clr_relay_C(unsigned char relay_no) {PORTC &= ~(1<<relay_no);}    
-void clr_all_C(void) {PORTC &= 0x00;}
+void set_relay_C(unsigned char relay_no) {ShadowC |= (1<<relay_no);}
+void clr_relay_C(unsigned char relay_no) {ShadowC &= ~(1<<relay_no);}    
+void clr_all_C(void) {ShadowC = 0x00;}
+
+void set_relay_A(unsigned char relay_no) {ShadowA |= (1<<relay_no);}
+void clr_relay_A(unsigned char relay_no) {ShadowA &= ~(1<<relay_no);}    
+void clr_all_A(void) {ShadowA = 0x00;}
+
+#if (CYCLE_COUNT == TRUE)
+void count_cycles(unsigned char setA, unsigned char setC)
+{ // adds one to the counters of the relays that are set; the counters are bit-sliced
+  // (vertical), so all relays of a block are counted at once: plane k holds bit k
+  unsigned char k, carry;
+  for (k=0; k < CNT_PLANES; k++) {
+    if ((setA | setC) == 0) return;
+    carry = CntA[k] & setA;
+    CntA[k] ^= setA;
+    setA = carry;
+    carry = CntC[k] & setC;
+    CntC[k] ^= setC;
+    setC = carry;
+  }
+  for (k=0; k < CNT_PLANES; k++) {                       // overflow: these counters wrapped to
+    CntA[k] |= setA;                                     // 0, keep them at their maximum
+    CntC[k] |= setC;
+  }
+}
+#endif
+
+void relays_pulse_start(unsigned char setC, unsigned char setA)
+{ // starts the pulse timers of these (just set) relays; timer i belongs to bit i of C, A
+  unsigned char i;
+  unsigned int bits, bit;
+  bits = setC | ((unsigned int)setA << 8);
+  T2_PulseExpired &= ~bits;
+  bit = 1;
+  for (i=0; i < 16; i++) {
+    if (bits & bit) {T2_TimerStart(T2_TIMER_PULSE + i, PulseTime);}
+    bit = bit << 1;
+  }
+}
+
+void relays_schedule(void)
+{ // sets the queued relays, at most RR_MaxOn per time slice; one write per block
+  // A time slice starts when the first relay is set with a full budget. Expired deadlines
+  // are cleared also while the queue is empty (relays_next_due), so they never wrap.
+  unsigned char setA, setC, pendA, pendC, bit;
+  if (SchedBreak) {
+    if (T2_Passed(SchedBreakEnd) == 0) {return;}
+    SchedBreak = 0;                                     // contacts are open now
+  }
+  if ((SchedBudget != RR_MaxOn) && T2_Passed(SchedSliceEnd)) {SchedBudget = RR_MaxOn;}
+  if (SchedCount == 0) {return;}                        // nothing to do
+  if (SchedBudget == RR_MaxOn) {SchedSliceEnd = T2_Now() + RR_Slice;}   // a new time slice
+  setA = 0;
+  setC = 0;
+  while (SchedCount) {
+    pendA = SchedA[0] & ~OutA;
+    pendC = SchedC[0] & ~OutC;
+    if (RR_MaxOn) {                                     // take relays one by one
+      while ((pendA | pendC) && SchedBudget) {
+        if (pendC) {bit = pendC & (~pendC + 1); pendC &= ~bit; setC |= bit;}  // lowest bit
+        else       {bit = pendA & (~pendA + 1); pendA &= ~bit; setA |= bit;}
+        SchedBudget--;
+      }
+    }
+    else {setA |= pendA; setC |= pendC; pendA = 0; pendC = 0;}
+    if (pendA | pendC) {                                // budget used up: continue next slice
+      SchedA[0] = pendA;
+      SchedC[0] = pendC;
+      break;
+    }
+    SchedCount--;                                       // entry done: shift the queue
+    for (bit=0; bit < SchedCount; bit++) {
+      SchedA[bit] = SchedA[bit+1];
+      SchedC[bit] = SchedC[bit+1];
+    }
+  }
+  if (setA) {out_write_A(OutA | setA);}
+  if (setC) {out_write_C(OutC | setC);}
+  #if (CYCLE_COUNT == TRUE)
+  count_cycles(setA, setC);                             // switching cycles per relay
+  #endif
+  if ((setA & PulseA) | (setC & PulseC)) {relays_pulse_start(setC & PulseC, setA & PulseA);}
+}
+
+void relays_commit(void)
+{ // releases relays at once, queues the relays to be set for the scheduler
+  unsigned char i, queuedA, queuedC;
+  if ((OutA & ~ShadowA) || (OutC & ~ShadowC)) {
+    out_write_A(OutA & ShadowA);                        // one write per block
+    out_write_C(OutC & ShadowC);
+    if (RR_Break) {SchedBreakEnd = T2_Now() + RR_Break; SchedBreak = 1;}
+  }
+  queuedA = 0;
+  queuedC = 0;
+  for (i=0; i < SchedCount; i++) {                      // forget relays released meanwhile
+    SchedA[i] &= ShadowA;
+    SchedC[i] &= ShadowC;
+    queuedA |= SchedA[i];
+    queuedC |= SchedC[i];
+  }
+  queuedA = ShadowA & ~OutA & ~queuedA;                 // relays that are newly requested
+  queuedC = ShadowC & ~OutC & ~queuedC;
+  if (queuedA | queuedC) {
+    if (SchedCount == SCHED_QUEUE) {SchedCount--;}      // queue full: add to the newest entry
+    else {SchedA[SchedCount] = 0; SchedC[SchedCount] = 0;}
+    SchedA[SchedCount] |= queuedA;
+    SchedC[SchedCount] |= queuedC;
+    SchedCount++;
+  }
+  relays_schedule();                                    // set what is possible right now
+}
+
+unsigned char rr_next(unsigned char RRBlock, unsigned char current)
+{ // returns the next active relay (as bit) after the current one; RRBlock is the list of
+  // active relays, one bit per relay. No loop: (x & -x) isolates the lowest bit of x
+  unsigned char rest;
+  rest = RRBlock & ~(current | (current - 1));     // active relays above the current one
+  if (rest == 0) {rest = RRBlock;}                 // wrap around
+  return rest & (~rest + 1);
+}
+
+unsigned char bit_index(unsigned char bit)
+{ // returns the number (0..7) of the bit that is set
+  unsigned char index;
+  index = 0;
+  if (bit & 0b11110000) {index += 4;}
+  if (bit & 0b11001100) {index += 2;}
+  if (bit & 0b10101010) {index += 1;}
+  return index;
+}
+
+unsigned char reverse_bits(unsigned char value)
+{ // relays 9-16 are connected in reversed order to PORTA (relay 9 = PA7)
+  value = (value << 4) | (value >> 4);                                 // swap nibbles
+  value = ((value & 0b00110011) << 2) | ((value & 0b11001100) >> 2);   // swap pairs
+  value = ((value & 0b01010101) << 1) | ((value & 0b10101010) >> 1);   // swap bits
+  return value;
+}
+
+void init_groups(void)
+{ // reads the mutual-exclusion groups (in port order)
+  unsigned char g;
+  for (g=0; g < GROUPS; g++) {
+    GroupC[g] = my_eeprom_read_byte(&CV.RGroup[g].MaskL);
+    GroupA[g] = reverse_bits(my_eeprom_read_byte(&CV.RGroup[g].MaskH));  // PORTA: reversed
+  }
+}
+
+void relays_exclude(unsigned char relay)
+{ // releases the relays that relay 0..15 excludes: its block in modes 0 and 1, and the other
+  // relays of the groups it belongs to, also in the other block
+  unsigned char g, bitA, bitC;
+  bitC = pgm_read_byte(&BitC[relay]);
+  bitA = pgm_read_byte(&BitA[relay]);
+  if (bitC && (ModeC <= 1)) {ShadowC = 0;}
+  if (bitA && (ModeA <= 1)) {ShadowA = 0;}
+  for (g=0; g < GROUPS; g++) {
+    if ((GroupC[g] & bitC) | (GroupA[g] & bitA)) {
+      ShadowC &= ~GroupC[g];
+      ShadowA &= ~GroupA[g];
+    }
+  }
+}
+
+unsigned char rr_runs(unsigned char blockMode)
+{ // round-robin runs in a block in mode 3, or in mode 0 after it was started
+  if (SeqPC != SEQ_IDLE) return 0;                       // a sequence program has the relays
+  return ((blockMode == 3) || ((blockMode == 0) && RRMode));
+}
+
+void init_bs_ranges(void)
+{ // copies the binary state range table from EEPROM to RAM
+  unsigned char i;
+  for (i=0; i < BS_RANGES; i++) {
+    BSRange[i].first = my_eeprom_read_byte(&CV.BSRange[i].FirstL) |
+                      (my_eeprom_read_byte(&CV.BSRange[i].FirstH) << 8);
+    BSRange[i].count = my_eeprom_read_byte(&CV.BSRange[i].Count);
+    BSRange[i].relay = my_eeprom_read_byte(&CV.BSRange[i].Relay) - 1;     // 1..16 => 0..15
+    if (BSRange[i].relay + BSRange[i].count > 16)                        // stay within 16 relays
+      {BSRange[i].count = (BSRange[i].relay < 16) ? 16 - BSRange[i].relay : 0;}
+  }
+}
+
+#define STATE_ALWAYS    1            // CV544: save after each change
+#define STATE_POWERFAIL 2            // CV544: save when the supply drops
+
+#define AC_SAMPLES      5            // the supply has failed if the comparator output stays
+#define AC_SAMPLE       20           // high for AC_SAMPLES samples, AC_SAMPLE us apart
+
+#if defined ENHANCED_PROCESSOR
+  #define AC_Vect    ANALOG_COMP_vect
+#else
+  #define AC_Vect    ANA_COMP_vect
+#endif
+
+void relays_changed(void)
+{ // the state should be saved, STATE_DELAY after the last change
+  if (StateSave != STATE_ALWAYS) return;
+  LogDue = T2_Now() + STATE_DELAY;
+  semaphor_set(C_DoSave);
+}
+
+unsigned char log_next_seq(unsigned char seq)
+{ // sequence numbers run from 0 to 254; 255 is the value of erased EEPROM
+  seq++;
+  if (seq == 0xFF) {seq = 0;}
+  return seq;
+}
+
+unsigned char log_next_slot(unsigned char slot)
+{
+  slot++;
+  if (slot == STATE_LOG) {slot = 0;}
+  return slot;
+}
+
+void relays_record(void)
+{ // fills LogRecord with the current state (not the sequence number)
+  LogRecord[0] = ShadowA & ~PulseA;
+  LogRecord[1] = ShadowC & ~PulseC;
+  LogRecord[2] = 0b01000000 | (RRMode ? 0b10000000 : 0) | ((ModeA & 0b00000011) << 2)
+               | (ModeC & 0b00000011);
+  LogRecord[3] = (bit_index(RRBitA) << 4) | bit_index(RRBitC);
+}
+
+ISR(AC_Vect)
+{
+  // The supply drops: save the state as fast as possible. Interrupts stay disabled.
+  unsigned char i, *eeptr;
+  for (i=0; i < AC_SAMPLES; i++) {                       // a short dip is no power failure
+    _mydelay_us(AC_SAMPLE);
+    if ((ACSR & (1<<ACO)) == 0) return;
+  }
+  out_off();                                             // relays off: less current
+  relays_record();
+  LogRecord[4] = log_next_seq(LogSeq);
+  eeptr = (unsigned char *) &CV.StateLog[log_next_slot(LogSlot)];
+  for (i=0; i < sizeof(t_state_record); i++) {           // sequence number last
+    while (!eeprom_is_ready()) ;
+    #if defined ENHANCED_PROCESSOR
+    if (LogArmed) {                                      // erased: write only (1.8 ms)
+      EEAR = (unsigned int) (eeptr + i);
+      EEDR = LogRecord[i];
+      EECR = (1<<EEPM1) | (1<<EEMPE);
+      EECR |= (1<<EEPE);
+      continue;
+    }
+    #endif
+    eeprom_write_byte(eeptr + i, LogRecord[i]);
+  }
+  while (!eeprom_is_ready()) ;
+  while (ACSR & (1<<ACO)) {_mydelay_us(AC_SAMPLE);}      // wait (for the brown-out reset)
+  _restart();                                            // supply is back: start again
+}
+
+void relays_restore(void)
+{ // finds the newest record in the state log and restores it (if CV544 is set)
+  unsigned char i, seq, info, pos;
+  LogSlot = STATE_LOG - 1;                               // if not found: start with slot 0
+  LogSeq  = 0xFE;
+  for (i=0; i < STATE_LOG; i++) {
+    seq = my_eeprom_read_byte(&CV.StateLog[i].Seq);
+    if (seq == 0xFF) continue;
+    if (my_eeprom_read_byte(&CV.StateLog[(i + 1) % STATE_LOG].Seq) == log_next_seq(seq)) continue;
+    info = my_eeprom_read_byte(&CV.StateLog[i].Info);
+    if ((info & 0b01000000) == 0) continue;              // never written
+    LogSlot = i;
+    LogSeq  = seq;
+    if (StateSave == 0) return;
+    ShadowA = my_eeprom_read_byte(&CV.StateLog[i].PortA);
+    ShadowC = my_eeprom_read_byte(&CV.StateLog[i].PortC);
+    pos     = my_eeprom_read_byte(&CV.StateLog[i].RRPos);
+    if ((info & 0b00001111) == ((ModeA << 2) | ModeC)) { // same modes as when saved
+      if (info & 0b10000000) {RRMode = 1;}               // continue at the same position
+      RRBitA = 1 << ((pos >> 4) & 0b00000111);
+      RRBitC = 1 << (pos & 0b00000111);
+      if (rr_runs(ModeA)) {
+        ShadowA = reverse_bits(RRBitA);
+        RRDueA = (unsigned long)RRDwell[8 + bit_index(RRBitA)] * RR_Tick;
+      }
+      if (rr_runs(ModeC)) {
+        ShadowC = RRBitC;
+        RRDueC = (unsigned long)RRDwell[bit_index(RRBitC)] * RR_Tick;
+      }
+    }
+    relays_commit();
+    return;
+  }
+}
+
+void action_mode0(unsigned char relay, unsigned char activate)
+{ // modes 0 and 1 differ only in the releases (relays_exclude) and in DEACTIVATE
+  if (activate) {
+    RRMode = 0;                                          // stop round-robin
+    relays_exclude(relay);                               // release block and groups,
+    ShadowC |= pgm_read_byte(&BitC[relay]);              // then set it
+    ShadowA |= pgm_read_byte(&BitA[relay]);
+  }
+  else if (relay == 15) {RRMode = 1;}                    // last relay - => round-robin
+  relays_commit();
+  relays_changed();
+}
+
+void action_mode12(unsigned char relay, unsigned char activate)
+{
+  if (activate) {
+    relays_exclude(relay);                               // release groups (and block in mode 1)
+    ShadowC |= pgm_read_byte(&BitC[relay]);
+    ShadowA |= pgm_read_byte(&BitA[relay]);
+  }
+  else {
+    ShadowC &= ~pgm_read_byte(&BitC[relay]);             // clear this specific relay
+    ShadowA &= ~pgm_read_byte(&BitA[relay]);
+  }
+  relays_commit();
+  relays_changed();
+}
+
+void action_mode3(unsigned char relay, unsigned char activate)
+{ // round-robin: commands are ignored
+}
+
+#if (SR_BLOCKS > 0)
+// Relays 17 and up (shift registers), per mode of CV536: no round-robin, groups, pulses,
+// dimming or state log
+void action_sr0(unsigned char relay, unsigned char activate)
+{ // mode 0: one relay of the register is set; DEACTIVATE is ignored
+  if (activate == 0) return;
+  SR_Shadow[(relay - 16) >> 3] = 1 << (relay & 0b00000111);
+  out_write_sr();
+}
+
+void action_sr1(unsigned char relay, unsigned char activate)
+{ // mode 1: at most one relay of the register is set
+  unsigned char block, bit;
+  block = (relay - 16) >> 3;
+  bit = 1 << (relay & 0b00000111);
+  if (activate) {SR_Shadow[block] = bit;}
+  else {SR_Shadow[block] &= ~bit;}
+  out_write_sr();
+}
+
+void action_sr2(unsigned char relay, unsigned char activate)
+{ // modes 2 and 3: each relay independently
+  unsigned char block, bit;
+  block = (relay - 16) >> 3;
+  bit = 1 << (relay & 0b00000111);
+  if (activate) {SR_Shadow[block] |= bit;}
+  else {SR_Shadow[block] &= ~bit;}
+  out_write_sr();
+}
+#endif
+
+t_action action_select(unsigned char blockMode)
+{
+  if (blockMode == 0) return action_mode0;
+  if (blockMode == 3) return action_mode3;
+  return action_mode12;
+}
+
+#if (SR_BLOCKS > 0)
+t_action action_select_sr(unsigned char srMode)
+{
+  if (srMode == 0) return action_sr0;
+  if (srMode == 1) return action_sr1;
+  return action_sr2;
+}
+#endif
+
+void relays_arm(void)
+{
+  // CV544 = 2: erases the slot after the newest record in the background (with relays_save),
+  // and enables the analog comparator interrupt
+  unsigned char i;
+  LogArmed = 0;
+  ACSR = (1<<ACD);                                       // comparator off
+  if (StateSave != STATE_POWERFAIL) return;
+  for (i=0; i < sizeof(t_state_record); i++) {LogRecord[i] = 0xFF;}
+  LogTarget = log_next_slot(LogSlot);
+  LogStep = 1;
+  DDRB  &= ~(1<<POWER_SENSE);                            // AIN1 is an input (init_main made
+  PORTB &= ~(1<<POWER_SENSE);                            // PORTB an output), no pull-up
+  ACSR = (1<<ACBG) | (1<<ACIS1) | (1<<ACIS0);            // bandgap to AIN0; rising output
+  _mydelay_us(70);                                       // start-up time of the bandgap
+  ACSR |= (1<<ACI);                                      // clear the interrupt flag set by
+  ACSR |= (1<<ACIE);                                     // the changes above, then enable
+}
+
+#if (CYCLE_COUNT == TRUE)
+unsigned int cycles_pending(unsigned char relay)
+{ // the counter of one relay in RAM
+  unsigned char k, *planes, bit;
+  unsigned int count;
+  if (relay < 8) {planes = CntC; bit = pgm_read_byte(&BitC[relay]);}
+  else           {planes = CntA; bit = pgm_read_byte(&BitA[relay]);}
+  count = 0;
+  for (k=CNT_PLANES; k > 0; k--) {
+    count <<= 1;
+    if (planes[k-1] & bit) {count |= 1;}
+  }
+  return count;
+}
+
+void cycles_clear(unsigned char relay)
+{ // sets the counter of one relay in RAM to 0
+  unsigned char k, *planes, bit;
+  if (relay < 8) {planes = CntC; bit = pgm_read_byte(&BitC[relay]);}
+  else           {planes = CntA; bit = pgm_read_byte(&BitA[relay]);}
+  for (k=0; k < CNT_PLANES; k++) {planes[k] &= ~bit;}
+}
 
-void set_relay_A(unsigned char relay_no) {PORTA |= (1<<relay_no);}
-void clr_relay_A(unsigned char relay_no) {PORTA &= ~(1<<relay_no);}    
-void clr_all_A(void) {PORTA &= 0x00;}
+unsigned char cycles_target(void)
+{ // the record of the cycle log that the next flush writes: the oldest
+  if (CntSlot == CYCLE_LOG - 1) return 0;
+  return CntSlot + 1;
+}
 
-void fill_array(unsigned char buffer[], unsigned char RRBlock)
-{ // copies the 8 values of a byte into eigth array values
-  unsigned char i, total_active;
-  total_active = 0;
-  for (i=0; i <8; i++) {                           // copy these values in an array
-    buffer[i] = RRBlock & 0b00000001;              // what is value of lowest bit?
-    RRBlock = RRBlock >> 1;                        // move right
-    total_active = total_active + buffer[i]; }     // check how many relays are active
-  if (total_active == 0) {buffer[0] = 1;}          // make at least 1 relay active
+unsigned long cycles_stored(unsigned char slot, unsigned char relay)
+{ // the total of one relay in a record of the cycle log
+  unsigned char *eeptr;
+  if ((slot == CntSlot) && (CntSeq == 0xFF)) return 0;   // no record written yet
+  eeptr = &CV.CycleLog[slot].Cycles[3 * relay];
+  return my_eeprom_read_byte(eeptr) | ((unsigned int)my_eeprom_read_byte(eeptr + 1) << 8)
+         | ((unsigned long)my_eeprom_read_byte(eeptr + 2) << 16);
 }
 
+void cycles_restore(void)
+{ // finds the newest record of the cycle log, like relays_restore in the state log, and
+  // starts counting from 0
+  unsigned char i, seq;
+  for (i=0; i < CNT_PLANES; i++) {
+    CntA[i] = 0;
+    CntC[i] = 0;
+  }
+  CntSlot = CYCLE_LOG - 1;                               // if not found: start with record 0
+  CntSeq  = 0xFF;
+  for (i=0; i < CYCLE_LOG; i++) {
+    seq = my_eeprom_read_byte(&CV.CycleLog[i].Seq);
+    if (seq == 0xFF) continue;                           // never written
+    if (my_eeprom_read_byte(&CV.CycleLog[(i + 1) % CYCLE_LOG].Seq) == log_next_seq(seq)) continue;
+    CntSlot = i;
+    CntSeq  = seq;
+    break;
+  }
+  CntStep = 0;
+  CntDue = T2_Now() + CNT_FLUSH;
+  CntGap = T2_Now() + CNT_GAP;
+}
+#endif
+
 //================================================================================================
 // 3. Main functions
 //================================================================================================
-void init_relays_actions(void)
-  {
+void relays_read_cvs(void)
+  { // (re)reads the CVs; called at power up and after a CV was written
+  unsigned char i;
   relaisActiveCmd = my_eeprom_read_byte(&CV.Ract); // cv532 - 0="-", 1="+" (on LH100)
   RR_BlockC       = my_eeprom_read_byte(&CV.RRR1); // cv533 - round-robin relays used, relays 1-8
-  fill_array(RBlockC, RR_BlockC);                  // copy values to an array (easier programming)
+  if (RR_BlockC == 0) {RR_BlockC = 1;}             // make at least 1 relay active
   RR_BlockA   = my_eeprom_read_byte(&CV.RRR2);     // cv534 - round-robin relays used, relays 9-16
-  fill_array(RBlockA, RR_BlockA);                  // copy values to an array (easier programming)
+  if (RR_BlockA == 0) {RR_BlockA = 1;}             // make at least 1 relay active
   RR_Interval = my_eeprom_read_byte(&CV.RInter);   // cv535                
   mode        = my_eeprom_read_byte(&CV.Mode);     // cv536   
-  RRMode = 0;                                      // No round-robin
-  if (mode == 3)        {RRMode = 1;}              // Except for mode == 3
+  ModeC = my_eeprom_read_byte(&CV.ModeL);          // cv872 - mode of relays 1-8
+  if (ModeC > 3) {ModeC = mode & 0b00000011;}      // 255: as cv536
+  ModeA = my_eeprom_read_byte(&CV.ModeH);          // cv873 - mode of relays 9-16
+  if (ModeA > 3) {ModeA = mode & 0b00000011;}
+  if ((ModeA != 0) && (ModeC != 0)) {RRMode = 0;}  // (mode 0 may have started round-robin)
   if (RR_Interval == 0) {RR_Interval = 1;}         // set minimum round-robin interval
+  PulseC = my_eeprom_read_byte(&CV.RPulseL);       // cv693 - relays 1-8 in pulse mode
+  PulseA = reverse_bits(my_eeprom_read_byte(&CV.RPulseH));   // cv694 - relays 9-16
+  PulseTime = my_eeprom_read_byte(&CV.RPulse) * 10;   // cv695 - pulse time
+  if (PulseTime == 0) {PulseTime = 10;}
+  RR_Tick = my_eeprom_read_byte(&CV.RTick) * 10;   // cv628 - unit of the times in ms
+  if (RR_Tick == 0) {RR_Tick = 10;}
+  for (i=0; i < 16; i++) {                         // cv612-627 - round-robin time per relay
+    RRDwell[i] = my_eeprom_read_byte(&CV.RDwell[i]);
+    if (RRDwell[i] == 0) {RRDwell[i] = RR_Interval;}
+  }
+  StateSave   = my_eeprom_read_byte(&CV.LastState);  // cv544 - save the relay state
+  RR_Break    = my_eeprom_read_byte(&CV.RBreak);   // cv609
+  RR_MaxOn    = my_eeprom_read_byte(&CV.RMaxOn);   // cv610
+  RR_Slice    = my_eeprom_read_byte(&CV.RSlice);   // cv611
+  if (RR_Slice == 0) {RR_Slice = 1;}               // set minimum time slice
+  init_bs_ranges();                                // binary state ranges (CV553-CV568)
+  init_groups();                                   // groups (CV874-CV881)
+  Action[0] = action_select(ModeC);                // resolve the modes once, not per command
+  Action[1] = action_select(ModeA);
+  #if (SR_BLOCKS > 0)
+  for (i=2; i < RELAYS / 8; i++) {Action[i] = action_select_sr(mode);}   // shift registers
+  #endif
+  }
+
+
+void init_relays_actions(void)
+  {
+  RRMode = 0;                                      // No round-robin (except for blocks in mode 3)
+  relays_read_cvs();
+  SchedCount  = 0;
+  SchedBudget = RR_MaxOn;
+  ShadowA = OutA;                                  // start with the current pattern
+  ShadowC = OutC;
+  RRBitA = 0;                                      // round-robin starts with the first relay,
+  RRBitC = 0;                                      // at once
+  RRDueA = T2_Now();
+  RRDueC = RRDueA;
+  SeqPC = SEQ_IDLE;                                // no sequence program running
+  PreviousCommand = 0xFF;                          // the first commands are new
+  PreviousAlias = 0xFF;
+  LogStep = 0;
+  relays_restore();                                // the state before power down (CV544)
+  relays_arm();                                    // prepare saving at power down (CV544 = 2)
+  #if (CYCLE_COUNT == TRUE)
+  cycles_restore();                                // switching cycle counters
+  #endif
   }
 
 
 void relays_actions(unsigned int Command)
   {
     unsigned char myCommand, myOperation, myRelay;
-    if (Command > 31) {return;}           // not our Address
+    if (Command >= 2 * RELAYS) {return;}  // not our Address
     myOperation = Command & 0b00000001;   // 0="-", 1="+"
-    myCommand = Command & 0b00011111;
+    myCommand = Command;
     myRelay = myCommand >> 1;
     // If this command is a retransmission, just ignore
     if (myCommand == PreviousCommand) {return;}      // do not repeat previous command
     PreviousCommand = myCommand;
-    // 
-    if (myRelay < 8)         // first block of relays: on PCB near LED
-    {
-      if (myOperation == relaisActiveCmd)                 // command says: set relay 
-      { if      (mode == 0) {clr_all_C(); RRMode = 0;}        // clear all relays on PORT C
-        else if (mode == 1) {clr_all_C();}                    // clear all relays on PORT C    
-        if      (mode == 0) {set_relay_C(myRelay);}           // set this specific relay
-        else if (mode == 1) {set_relay_C(myRelay);}           // set this specific relay      
-        else if (mode == 2) {set_relay_C(myRelay);}           // set this specific relay      
+    // The handler of the block already knows its mode (see relays_read_cvs)
+    Action[myRelay >> 3](myRelay, myOperation == relaisActiveCmd);
+  }  // End of procedure relays_actions 
+
+
+void relays_toggle(unsigned char relay)
+{ // local button (keyboard.c): the command that inverts relay 0..RELAYS-1, as if sent via DCC
+  unsigned char set;
+  if (relay >= RELAYS) {return;}
+  if (relay < 16) {
+    set = (ShadowC & pgm_read_byte(&BitC[relay])) | (ShadowA & pgm_read_byte(&BitA[relay]));
+  }
+#if (SR_BLOCKS > 0)
+  else {set = SR_Shadow[(relay - 16) >> 3] & (1 << (relay & 0b00000111));}
+#endif
+  PreviousCommand = 0xFF;                        // a button is no retransmission
+  PreviousAlias = 0xFF;                          // (also not of the last alias command)
+  relays_actions((relay << 1) | ((set != 0) ^ (relaisActiveCmd != 0)));
+}
+
+
+void relays_round_robin(void)
+{
+  // Each block has its own schedule. The next deadline is calculated from the previous
+  // deadline, not from the moment the switch was made. Only if the main loop was stalled
+  // longer than a complete relay time, the schedule restarts from now (no burst of switches).
+  unsigned long now, dwell;
+  unsigned char changed;
+  now = T2_Now();
+  changed = 0;
+  // Port A (near output connector). Note: ports are reversed order
+  if (!rr_runs(ModeA)) {RRDueA = now;}                        // not active: (re)start at once
+  else if ((long)(now - RRDueA) >= 0) {
+    RRBitA = rr_next(RR_BlockA, RRBitA);                      // next active relay
+    dwell = (unsigned long)RRDwell[8 + bit_index(RRBitA)] * RR_Tick;
+    RRDueA += dwell;
+    if ((long)(now - RRDueA) >= 0) {RRDueA = now + dwell;}
+    ShadowA = reverse_bits(RRBitA);                           // only this relay in this block
+    changed = 1;
+  }
+  // Port C (near LED)
+  if (!rr_runs(ModeC)) {RRDueC = now;}
+  else if ((long)(now - RRDueC) >= 0) {
+    RRBitC = rr_next(RR_BlockC, RRBitC);                      // next active relay
+    dwell = (unsigned long)RRDwell[bit_index(RRBitC)] * RR_Tick;
+    RRDueC += dwell;
+    if ((long)(now - RRDueC) >= 0) {RRDueC = now + dwell;}
+    ShadowC = RRBitC;                                         // only this relay in this block
+    changed = 1;
+  }
+  if (changed) {relays_commit();}
+}
+
+
+void relays_binary_state(unsigned int BinState, unsigned char Activate)
+{
+  // A binary state is mapped onto a relay via the range table; the offset within a range is
+  // calculated unsigned, so a single compare checks both bounds of that range.
+  unsigned char i;
+  unsigned int offset;
+  if (BinState == 0) {return;}                            // broadcast: ignore
+  for (i=0; i < BS_RANGES; i++) {
+    offset = BinState - BSRange[i].first;
+    if (offset < BSRange[i].count) {
+      // translate into the same command format as used for accessory addresses
+      if (Activate) {relays_actions(((BSRange[i].relay + offset) << 1) | relaisActiveCmd);}
+      else          {relays_actions(((BSRange[i].relay + offset) << 1) | (relaisActiveCmd ^ 1));}
+      return;
+    }
+  }
+}
+
+
+void relays_alias(unsigned char Entry, unsigned char Operation)
+{
+  // The masks are read from EEPROM only now, since alias addresses are received rarely.
+  // Retransmissions are ignored as in relays_actions, but with a state of their own, so that
+  // repeated packets to an alias and to our own addresses do not make each other new. So a
+  // sequence program is not restarted by the repetitions of the packet that started it.
+  unsigned char maskC, maskA, op;
+  if (((Entry << 1) | Operation) == PreviousAlias) {return;}
+  PreviousAlias = (Entry << 1) | Operation;
+  maskC = my_eeprom_read_byte(&CV.Alias[Entry].MaskL);               // relays 1-8
+  maskA = reverse_bits(my_eeprom_read_byte(&CV.Alias[Entry].MaskH)); // relays 9-16
+  op    = my_eeprom_read_byte(&CV.Alias[Entry].Op);
+  if (Operation == relaisActiveCmd)            // command says: ACTIVATE
+  { if (op == ALIAS_EXCLUSIVE) {
+      RRMode = 0;                              // as a normal ACTIVATE: stop round-robin
+      if (maskC) {ShadowC = maskC;}            // release the others, set the masked relays
+      if (maskA) {ShadowA = maskA;}
+    }
+    else if (op == ALIAS_SET) {ShadowC |= maskC; ShadowA |= maskA;}
+    else if (op == ALIAS_RELEASE) {ShadowC &= ~maskC; ShadowA &= ~maskA;}
+    else if (op == ALIAS_SEQUENCE) {
+      RRMode = 0;                              // the program takes over from round-robin
+      SeqPC = my_eeprom_read_byte(&CV.Alias[Entry].MaskL);
+      if (SeqPC >= SEQ_SIZE) {SeqPC = SEQ_IDLE;}
+      SeqDepth = 0;
+      SeqDue = T2_Now();                       // start at once
+    }
+  }
+  else                                         // command says: DEACTIVATE
+  { if (op == ALIAS_SET) {ShadowC &= ~maskC; ShadowA &= ~maskA;}
+    else if (op == ALIAS_SEQUENCE) {SeqPC = SEQ_IDLE;}
+  }
+  relays_commit();
+  relays_changed();
+}
+
+
+void relays_analog(unsigned char Output, unsigned char Level)
+{
+  // Analog function output 1..16 sets the level (dimming) of relay 1..16 (not stored)
+  if ((Output == 0) || (Output > 16)) return;
+  out_set_level(Output - 1, Level);
+}
+
+
+void relays_save(void)
+{
+  // Writes the relay state in the next record of the log, one byte per call, and only when the
+  // EEPROM is ready (so the main loop never waits). The sequence number is written last.
+  unsigned char i, *eeptr;
+  if (LogStep == 0) {
+    if (semaphor_query(C_DoSave) == 0) return;
+    if (T2_Passed(LogDue) == 0) return;
+    semaphor_get(C_DoSave);
+    relays_record();
+    eeptr = (unsigned char *) &CV.StateLog[LogSlot];
+    for (i=0; i < 4; i++) {                              // same as the newest record?
+      if (my_eeprom_read_byte(eeptr + i) != LogRecord[i]) break;
+    }
+    if ((i == 4) && (my_eeprom_read_byte(&CV.StateLog[LogSlot].Seq) == LogSeq)) return;
+    LogSlot = log_next_slot(LogSlot);
+    LogTarget = LogSlot;
+    LogSeq = log_next_seq(LogSeq);
+    LogRecord[4] = LogSeq;
+    LogStep = 1;
+  }
+  if (!eeprom_is_ready()) return;
+  eeptr = (unsigned char *) &CV.StateLog[LogTarget];
+  if (my_eeprom_read_byte(eeptr + LogStep - 1) != LogRecord[LogStep - 1]) {
+    my_eeprom_write_byte(eeptr + LogStep - 1, LogRecord[LogStep - 1]);
+  }
+  LogStep++;
+  if (LogStep > sizeof(t_state_record)) {
+    LogStep = 0;
+    if (StateSave == STATE_POWERFAIL) {LogArmed = 1;}     // the erase is done
+  }
+}
+
+
+
+unsigned long relays_cycles(unsigned char relay)
+{ // the number of times relay 0..15 was set (for CV883-CV885); 0 without CYCLE_COUNT
+  #if (CYCLE_COUNT == TRUE)
+  unsigned long count;
+  unsigned char step;
+  if (relay > 15) return 0;
+  count = cycles_pending(relay);                                   // not yet in EEPROM
+  step = CntStep - 1;                                              // next byte of a flush
+  if ((CntStep == 0) || (3 * relay >= step)) {count += cycles_stored(CntSlot, relay);}
+  else if (3 * relay + 3 <= step) {count += cycles_stored(cycles_target(), relay);}
+  else {count += CntTotal;}                                        // being written
+  return count;
+  #else
+  return 0;
+  #endif
+}
+
+
+void relays_count_save(void)
+{
+  // Adds the counted switching cycles to the totals in the next record of the cycle log, once
+  // per CNT_FLUSH, or earlier if a counter in RAM is halfway full, but not within CNT_GAP after
+  // the last flush. Like relays_save, one EEPROM byte is written per call, and only when the
+  // EEPROM is ready. The counter of a relay is moved to CntTotal when its first byte is written,
+  // so the relay counts on from 0 meanwhile. The sequence number is written last; until then the
+  // record does not continue the sequence, so after a power loss the previous record is used.
+  #if (CYCLE_COUNT == TRUE)
+  unsigned char k, target, step, any;
+  if (CntStep == 0) {
+    if (T2_Passed(CntDue) == 0) {
+      if ((CntA[CNT_PLANES-1] | CntC[CNT_PLANES-1]) == 0) return;
+      if (T2_Passed(CntGap) == 0) return;
+    }
+    CntDue = T2_Now() + CNT_FLUSH;
+    CntGap = T2_Now() + CNT_GAP;
+    any = 0;
+    for (k=0; k < CNT_PLANES; k++) {any |= CntA[k] | CntC[k];}
+    if (any == 0) return;                                // nothing switched
+    CntStep = 1;
+  }
+  if (!eeprom_is_ready()) return;
+  target = cycles_target();
+  step = CntStep - 1;
+  if (step < 48) {                                       // totals, 3 bytes per relay
+    if ((step % 3) == 0) {
+      CntTotal = cycles_stored(CntSlot, step / 3) + cycles_pending(step / 3);
+      cycles_clear(step / 3);
+    }
+    k = (unsigned char)(CntTotal >> (8 * (step % 3)));
+    if (my_eeprom_read_byte(&CV.CycleLog[target].Cycles[step]) != k) {
+      my_eeprom_write_byte(&CV.CycleLog[target].Cycles[step], k);
+    }
+  }
+  else {                                                 // then the sequence number
+    CntSeq = log_next_seq(CntSeq);
+    my_eeprom_write_byte(&CV.CycleLog[target].Seq, CntSeq);
+    CntSlot = target;
+    CntStep = 0;
+    return;
+  }
+  CntStep++;
+  #endif
+}
+
+
+void relays_pulse(void)
+{
+  // releases the relays of which the pulse time has passed
+  if (T2_PulseExpired == 0) return;             // (set by T2_TimerRun, also in the main loop)
+  ShadowC &= ~(T2_PulseExpired & 0xFF);
+  ShadowA &= ~(T2_PulseExpired >> 8);
+  T2_PulseExpired = 0;
+  relays_commit();
+}
+
+
+void relays_sequencer(void)
+{
+  // Executes the running sequence program, if its next instruction is due. An instruction that
+  // does not fit completely in the sequence area, or an unknown opcode, ends the program.
+  unsigned long now, wait;
+  unsigned char ops, op, count;
+  if (SeqPC == SEQ_IDLE) return;
+  now = T2_Now();
+  if ((long)(now - SeqDue) < 0) return;
+  for (ops = 0; ops < SEQ_OPS; ops++) {
+    op = my_eeprom_read_byte(&CV.Seq[SeqPC]);
+    if ((op == SEQ_STEP) && (SeqPC <= SEQ_SIZE - 4)) {
+      ShadowC = my_eeprom_read_byte(&CV.Seq[SeqPC + 1]);               // relays 1-8
+      ShadowA = reverse_bits(my_eeprom_read_byte(&CV.Seq[SeqPC + 2])); // relays 9-16
+      wait = (unsigned long)my_eeprom_read_byte(&CV.Seq[SeqPC + 3]) * RR_Tick;
+      SeqPC += 4;
+      SeqDue += wait;                          // from the previous deadline: no drift
+      if ((long)(now - SeqDue) >= 0) {SeqDue = now + wait;} // (unless we were stalled)
+      relays_commit();
+      return;
+    }
+    else if ((op == SEQ_LOOP) && (SeqPC <= SEQ_SIZE - 3)) {
+      count = my_eeprom_read_byte(&CV.Seq[SeqPC + 2]);
+      if (count == 0) {                                           // endless loop
+        SeqPC = my_eeprom_read_byte(&CV.Seq[SeqPC + 1]);
       }
-      else                                                    // command says: clear relay
-      { if      (mode == 0) {}                                // ignore
-        else if (mode == 1) {clr_relay_C(myRelay);}           // clear this specific relay
-        else if (mode == 2) {clr_relay_C(myRelay);}           // clear this specific relay
+      else {
+        if ((SeqDepth == 0) || (SeqLoopPC[SeqDepth - 1] != SeqPC)) { // reached first time
+          if (SeqDepth == SEQ_NESTING) {SeqPC = SEQ_IDLE; return;}
+          SeqLoopPC[SeqDepth] = SeqPC;
+          SeqLoopCnt[SeqDepth] = count - 1;
+          SeqDepth++;
+        }
+        if (SeqLoopCnt[SeqDepth - 1] == 0) {                      // loop done
+          SeqDepth--;
+          SeqPC += 3;
+        }
+        else {
+          SeqLoopCnt[SeqDepth - 1]--;
+          SeqPC = my_eeprom_read_byte(&CV.Seq[SeqPC + 1]);
+        }
       }
+      if (SeqPC >= SEQ_SIZE) {SeqPC = SEQ_IDLE; return;}
     }
-    else if (myRelay < 16)   // second block of relays: near output
-    {
-      myRelay = 15 - myRelay;                                 // Relay 8..15 => 7..0
-      if (myOperation == relaisActiveCmd)                 // command says: set relay 
-      { if      (mode == 0) {clr_all_A(); RRMode = 0;}        // clear all relays on PORT A
-        else if (mode == 1) {clr_all_A();}                    // clear all relays on PORT A    
-        if      (mode == 0) {set_relay_A(myRelay);}           // set this specific relay
-        else if (mode == 1) {set_relay_A(myRelay);}           // set this specific relay      
-        else if (mode == 2) {set_relay_A(myRelay);}           // set this specific relay      
-      }    
-      else                                                    // command says: clear relay
-      { if      (mode == 0) {if (myRelay == 0) {RRMode = 1;}} // last relay - => round-robin
-        else if (mode == 1) {clr_relay_A(myRelay);}           // clear this specific relay
-        else if (mode == 2) {clr_relay_A(myRelay);}           // clear this specific relay
-      }
+    else {                                     // SEQ_END (or invalid instruction)
+      SeqPC = SEQ_IDLE;
+      return;
     }
-  }  // End of procedure relays_actions 
+  }
+}
 
 
-void relays_round_robin(void)
+void relays_due(unsigned long *due, unsigned long deadline)
+{ // lowers *due to deadline, if that is earlier
+  if ((long)(deadline - *due) < 0) {*due = deadline;}
+}
+
+
+void relays_next_due(unsigned long now, unsigned long *due)
 {
-  if (T2_Seconds >= RR_Interval)	
-  {
-    T2_Seconds = 0;
-    if (RRMode > 0)
-    { 
-      // Port A (near output connector). Note: ports are reversed order
-      clr_all_A();                                            // clear all relays in this block      
-      while (RBlockA[RBlockA_Next] == 0) {                   // while relay not active
-        RBlockA_Next = (RBlockA_Next + 1) % 8;}               // next relay, modulus 8
-      set_relay_A(7 - RBlockA_Next);                              // set relay
-      RBlockA_Next = (RBlockA_Next + 1) % 8;                  // next relay, modulus 8
-      // Port C (near LED)
-      clr_all_C();                                            // clear all relays in this block      
-      while (RBlockC[RBlockC_Next] == 0) {                   // while relay not active
-        RBlockC_Next = (RBlockC_Next + 1) % 8;}               // next relay, modulus 8
-      set_relay_C(RBlockC_Next);                              // set relay
-      RBlockC_Next = (RBlockC_Next + 1) % 8;                  // next relay, modulus 8
-    };
+  // Lowers *due to the earliest deadline of the relays tasks: round-robin, the sequencer, and
+  // the start of saving the state or the switching cycles. Relays waiting in the scheduler
+  // (inrush, break-before-make) are checked every ms. Pulses post their own event.
+  if (SchedCount) {relays_due(due, now + 1);}
+  if (SchedBreak) {relays_due(due, SchedBreakEnd);}                // clear expired deadlines
+  if (SchedBudget != RR_MaxOn) {relays_due(due, SchedSliceEnd);}
+  if (rr_runs(ModeA)) {relays_due(due, RRDueA);}
+  if (rr_runs(ModeC)) {relays_due(due, RRDueC);}
+  if (SeqPC != SEQ_IDLE) {relays_due(due, SeqDue);}
+  if ((LogStep == 0) && semaphor_query(C_DoSave)) {relays_due(due, LogDue);}
+  #if (CYCLE_COUNT == TRUE)
+  if (CntStep == 0) {
+    if (CntA[CNT_PLANES-1] | CntC[CNT_PLANES-1]) {relays_due(due, CntGap);}
+    else {relays_due(due, CntDue);}
   }
+  #endif
+}
+
+
+unsigned char relays_save_ready(void)
+{ // 1 if relays_save or relays_count_save can do something right now
+  #if (CYCLE_COUNT == TRUE)
+  if (CntStep) {return eeprom_is_ready();}                       // next byte of a record
+  if ((CntA[CNT_PLANES-1] | CntC[CNT_PLANES-1]) && T2_Passed(CntGap)) return 1;  // halfway full
+  if (T2_Passed(CntDue)) return 1;
+  #endif
+  if (LogStep) {return eeprom_is_ready();}
+  if (semaphor_query(C_DoSave) && T2_Passed(LogDue)) return 1;
+  return 0;
+}
+
+
+unsigned char relays_save_busy(void)
+{ // 1 while a record is being written (and the EEPROM is needed)
+  #if (CYCLE_COUNT == TRUE)
+  if (CntStep) return 1;
+  #endif
+  return LogStep != 0;
 }
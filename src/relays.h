@@ -8,6 +8,20 @@
 //-------------------------------------------------------------------------------
 
 void init_relays_actions(void);
+void relays_read_cvs(void);
 void relays_actions(unsigned int Command);
+void relays_toggle(unsigned char relay);
 void relays_round_robin(void);
+void relays_schedule(void);
+void relays_binary_state(unsigned int BinState, unsigned char Activate);
+void relays_alias(unsigned char Entry, unsigned char Operation);
+void relays_sequencer(void);
+void relays_pulse(void);
+void relays_analog(unsigned char Output, unsigned char Level);
+void relays_save(void);
+void relays_count_save(void);
+unsigned long relays_cycles(unsigned char relay);
+void relays_next_due(unsigned long now, unsigned long *due);
+unsigned char relays_save_ready(void);
+unsigned char relays_save_busy(void);
 
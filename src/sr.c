@@ -0,0 +1,109 @@
+//------------------------------------------------------------------------
+//
+// file:      sr.c
+//
+// purpose:   Additional relays via a chain of 74HC595 shift registers on PORTB (SPI)
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at http://www.gnu.org/licenses/gpl.txt
+//
+//------------------------------------------------------------------------
+//
+// SR_BLOCKS (config.h) shift registers are chained on the flat cable connector (PORTB):
+// MOSI to SER of the first 74HC595, SCK to SRCLK of all, SR_LATCH (= SS) to RCLK of all and
+// SR_OE to /OE of all. Q7' of each register goes to SER of the next one. Each register drives
+// eight relays (via a driver such as the ULN2803): relays 17-24, 25-32, and so on.
+//
+// relays.c changes SR_Shadow and calls sr_update(). The image is copied to SR_Out and shifted
+// out by the SPI interrupt, one byte per interrupt, so a refresh never blocks the main loop;
+// the new pattern is latched to all outputs at the same moment. A change during a transfer is
+// sent once the transfer has finished (only the newest image is latched).
+// The outputs are enabled (SR_OE low) only after the first image was latched, since the
+// registers have a random content at power up.
+//
+//------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <avr/pgmspace.h>        // put var to program memory
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+
+#include "config.h"              // general definitions the decoder, cv's
+#include "hardware.h"            // port definitions for target
+
+#include "sr.h"
+
+#if (SR_BLOCKS > 0)
+
+//--------------------------------------------------------------------------------------
+// Global Data
+unsigned char SR_Shadow[SR_BLOCKS];      // the relays pattern, written by relays.c
+
+// local variables
+unsigned char SR_Out[SR_BLOCKS];         // the pattern being shifted out
+volatile unsigned char SR_Index;         // number of bytes still to send
+volatile unsigned char SR_Busy;          // 1: transfer running
+volatile unsigned char SR_Pending;       // 1: SR_Shadow changed during the transfer
+
+
+void sr_start(void)
+{ // copies the image and sends the first byte; the byte for the last register goes first
+  unsigned char i;
+  for (i=0; i < SR_BLOCKS; i++) {SR_Out[i] = SR_Shadow[i];}
+  SR_Index = SR_BLOCKS - 1;
+  SR_Busy = 1;
+  SPDR = SR_Out[SR_BLOCKS - 1];
+}
+
+
+ISR(SPI_STC_vect)
+{
+  if (SR_Index) {
+    SR_Index--;
+    SPDR = SR_Out[SR_Index];
+    return;
+  }
+  PORTB |= (1<<SR_LATCH);                // all bytes sent: latch
+  PORTB &= ~(1<<SR_LATCH);
+  PORTB &= ~(1<<SR_OE);                  // enable the outputs (after the first image)
+  if (SR_Pending) {
+    SR_Pending = 0;
+    sr_start();
+  }
+  else SR_Busy = 0;
+}
+
+
+void sr_update(void)
+{
+  unsigned char sreg;
+  sreg = SREG;
+  cli();
+  if (SR_Busy) SR_Pending = 1;           // the ISR sends it after the current transfer
+  else sr_start();
+  SREG = sreg;
+}
+
+
+void init_sr(void)
+{
+  unsigned char i;
+  PORTB |= (1<<SR_OE);                   // outputs off until the first image is latched
+  PORTB &= ~((1<<SR_LATCH) | (1<<SR_MOSI) | (1<<SR_SCK));
+  DDRB  |= (1<<SR_OE) | (1<<SR_LATCH) | (1<<SR_MOSI) | (1<<SR_SCK);
+  for (i=0; i < SR_BLOCKS; i++) {SR_Shadow[i] = 0;}
+  SR_Busy = 0;
+  SR_Pending = 0;
+  SPCR = (1<<SPIE) | (1<<SPE) | (1<<MSTR) | (1<<SPR0);   // master, mode 0, F_CPU/16
+  sr_update();
+}
+
+#else
+
+void init_sr(void) {}
+void sr_update(void) {}
+
+#endif
@@ -0,0 +1,17 @@
+//------------------------------------------------------------------------
+//
+// file:      sr.h
+//
+// purpose:   Additional relays via a chain of 74HC595 shift registers on PORTB (SPI)
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at http://www.gnu.org/licenses/gpl.txt
+//
+//------------------------------------------------------------------------
+// Global Data: 
+#if (SR_BLOCKS > 0)
+extern unsigned char SR_Shadow[SR_BLOCKS];   // relays 17-24 (bit 0 = relay 17), 25-32, ...
+#endif
+
+void init_sr(void);                          // sets up SPI and clears the chain
+void sr_update(void);                        // sends SR_Shadow to the chain (non blocking)
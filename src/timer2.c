@@ -25,6 +25,7 @@
 #include "hardware.h"            // port definitions for target
 
 #include "timer2.h"
+#include "events.h"
 #include "main.h"
 
 //--------------------------------------------------------------------------------------
@@ -53,14 +54,39 @@
   #define TC2_Interrupt_Mask_Register				TIMSK2				// Register
   #define TC2_Control_Register_A					TCCR2A				// Register
   #define TC2_Control_Register_B					TCCR2B				// Register
+  #define TC2_Interrupt_Flag_Register				TIFR2				// Register
   #define TC2_Output_Compare_Match_Interrupt_Enable	OCIE2A 				// Bit definition
+  #define TC2_Output_Compare_Flag					OCF2A 				// Bit definition
 #else 
   #define TC2_Compare_Match_Vect					TIMER2_COMP_vect
   #define TC2_Output_Compare_Register				OCR2
   #define TC2_Interrupt_Mask_Register				TIMSK
   #define TC2_Control_Register_A					TCCR2				// Note: A and B are
   #define TC2_Control_Register_B					TCCR2				// here the same register
+  #define TC2_Interrupt_Flag_Register				TIFR
   #define TC2_Output_Compare_Match_Interrupt_Enable	OCIE2 
+  #define TC2_Output_Compare_Flag					OCF2 
+#endif
+
+#define T2_PRESCALER   256      // may be 1, 8, 32, 64, 128, 256, 1024
+#define T2_US16_PER_COUNT (16000000UL * T2_PRESCALER / F_CPU)  // us per count of Timer2, x 16
+
+// For most crystals a millisecond is no whole number of Timer2 counts (11.0592 MHz: 43.2 counts).
+// Rounding to 43 would make the clock 0.46% fast. Therefore the period (in CTC mode: OCR2 + 1
+// counts) alternates between T2_COUNTS and T2_COUNTS + 1, Bresenham style: the ISR adds T2_FRAC
+// to an accumulator each ms, and makes the next period one count longer each time the accumulator
+// passes T2_DENOM. Over T2_DENOM ms exactly F_CPU / T2_PRESCALER * T2_DENOM / 1000 counts pass,
+// so the clock does not drift for any XTAL in the Makefile (the crystal itself excepted).
+#define T2_COUNTS      (F_CPU / (T2_PRESCALER * 1000UL))     // whole counts per ms
+#define T2_TOP         (T2_COUNTS - 1)                       // OCR2 for a period of T2_COUNTS
+#if ((F_CPU % T2_PRESCALER) == 0)
+  #define T2_DENOM     1000U                                 // fraction per ms in 1/1000 count
+  #define T2_FRAC      ((unsigned int)((F_CPU / T2_PRESCALER) % 1000U))
+  typedef unsigned int t_T2_acc;
+#else
+  #define T2_DENOM     (T2_PRESCALER * 1000UL)               // fraction per ms in 1/256000 count
+  #define T2_FRAC      (F_CPU % (T2_PRESCALER * 1000UL))
+  typedef unsigned long t_T2_acc;
 #endif
 
 //--------------------------------------------------------------------------------------
@@ -69,28 +95,214 @@
 //
 //--------------------------------------------------------------------------------------
 // Global Data: 
-volatile unsigned char T2_Seconds;			 // Seconds counted by timer 2
+volatile unsigned long T2_Millis;			 // Milliseconds since power-up (wraps after 49 days)
+
+unsigned int  T2_PulseExpired;				 // pulse timers that have run out (cleared by the user)
 
-// local variables
-unsigned int T2_MilliSeconds;
+// local variables: the wake up of the main loop
+volatile unsigned long T2_Wakeup;			 // moment (T2_Millis) to post C_Tick
+volatile unsigned char T2_WakeArmed;		 // 1: T2_Wakeup is valid
+
+// local variables: the timer wheel
+#define T2_WHEEL     8						 // slots (ms) of the wheel, a power of 2
+#define T2_NONE      0xFF					 // end of a list / timer not running
+volatile unsigned char T2_Slot;				 // slot of the current millisecond
+volatile unsigned char T2_Passes[T2_WHEEL];	 // passes of the ISR not yet handled by T2_TimerRun
+unsigned char T2_Head[T2_WHEEL];			 // first timer of each slot
+unsigned char T2_Next[T2_TIMERS];			 // next timer in the same slot
+unsigned char T2_Prev[T2_TIMERS];			 // previous timer in the same slot (T2_NONE: first)
+unsigned char T2_InSlot[T2_TIMERS];			 // slot of a running timer, else T2_NONE
+unsigned int  T2_Rounds[T2_TIMERS];			 // full turns of the wheel still to wait
+t_T2_handler  T2_Handler[T2_TIMER_PULSE];	 // called (by T2_TimerRun) when the timer expires;
+											 // a pulse timer only sets its bit in T2_PulseExpired
+t_T2_acc      T2_Acc;						 // fraction of a count carried to the next ms
 //--------------------------------------------------------------------------------------
 //
 // Define Interrupt Service routines (ISR) for Timer2
 //
 //--------------------------------------------------------------------------------------
 
+void T2_Unlink(unsigned char id)
+{
+  // removes a running timer from its slot; interrupts must be disabled
+  if (T2_Prev[id] == T2_NONE) {T2_Head[T2_InSlot[id]] = T2_Next[id];}
+  else {T2_Next[T2_Prev[id]] = T2_Next[id];}
+  if (T2_Next[id] != T2_NONE) {T2_Prev[T2_Next[id]] = T2_Prev[id];}
+  T2_InSlot[id] = T2_NONE;
+}
+
+
 ISR(TC2_Compare_Match_Vect)
 {
-  // This ISR is called whenever Timer2, which is set to roughly 1 ms, fires
-  TCNT2 = 0;					// Reset counter 2 (this counter)
-  T2_MilliSeconds++;            // Another millisecond has passed
-  if (T2_MilliSeconds > 999) {  // Another second has passed
-    T2_Seconds++;
-    T2_MilliSeconds = 0;
-    }
+  // This ISR is called whenever Timer2 fires: on average exactly once per ms
+  // In CTC mode the hardware has already cleared TCNT2; clearing it here again would lose the
+  // counts passed since the compare match. The period that just started is set to T2_COUNTS
+  // or T2_COUNTS + 1 counts; TCNT2 is still far below OCR2, so the match is never missed.
+  T2_Acc += T2_FRAC;
+  if (T2_Acc >= T2_DENOM) {
+    T2_Acc -= T2_DENOM;
+    TC2_Output_Compare_Register = T2_TOP + 1;
+  }
+  else {TC2_Output_Compare_Register = T2_TOP;}
+  T2_Millis++;                  // Another millisecond has passed
+  if (T2_WakeArmed && ((long)(T2_Millis - T2_Wakeup) >= 0)) {
+    T2_WakeArmed = 0;
+    event_post(C_Tick);         // a deadline of the main loop has passed
+  }
+  event_button();               // program button: release debounce (events.c)
+  // Timer wheel: the slot of this millisecond is only marked, T2_TimerRun visits its timers
+  T2_Slot = (T2_Slot + 1) & (T2_WHEEL - 1);
+  if (T2_Head[T2_Slot] != T2_NONE) {
+    T2_Passes[T2_Slot]++;
+    event_post(C_Tick);
+  }
 } 
 
 
+//--------------------------------------------------------------------------------------
+//
+// Timers
+//
+//--------------------------------------------------------------------------------------
+// All software timers of the decoder run on the timer wheel above, so one hardware timer and
+// one ISR serve them all. Starting and cancelling a timer takes a constant time (a timer is
+// added to or removed from the doubly linked list of one slot); per millisecond only the
+// timers in one slot are visited. A timer of more than T2_WHEEL ms waits a number of rounds.
+// The ISR does not visit the timers itself: it counts the passes over a slot that holds timers
+// and posts C_Tick, so its run time does not depend on the number of timers that expire.
+// The main loop then calls T2_TimerRun, which subtracts the passes from the rounds of the
+// timers in the marked slots and calls the handlers of the expired ones. So the handlers run
+// with interrupts enabled; they may start their own timer again, but should not cancel other
+// timers. A handler is late by the time the main loop needs to react to C_Tick.
+
+void T2_TimerStart(unsigned char id, unsigned int ms)
+{
+  // (re)starts timer id; its handler is called after ms milliseconds (1..65535)
+  unsigned char sreg, slot;
+  if (ms == 0) {ms = 1;}
+  sreg = SREG;
+  cli();
+  if (T2_InSlot[id] != T2_NONE) {T2_Unlink(id);}
+  slot = (T2_Slot + ms) & (T2_WHEEL - 1);
+  T2_Rounds[id] = (ms - 1) / T2_WHEEL + T2_Passes[slot];   // (passes before the start)
+  T2_Prev[id] = T2_NONE;
+  T2_Next[id] = T2_Head[slot];
+  if (T2_Head[slot] != T2_NONE) {T2_Prev[T2_Head[slot]] = id;}
+  T2_Head[slot] = id;
+  T2_InSlot[id] = slot;
+  SREG = sreg;
+}
+
+
+void T2_TimerCancel(unsigned char id)
+{
+  unsigned char sreg = SREG;
+  cli();
+  if (T2_InSlot[id] != T2_NONE) {T2_Unlink(id);}
+  SREG = sreg;
+}
+
+
+void T2_TimerRun(void)
+{
+  // main loop (C_Tick): handles the passes of the ISR over the wheel, oldest slot first
+  unsigned char i, now, slot, passes, id, next;
+  now = T2_Slot;
+  for (i=1; i <= T2_WHEEL; i++) {
+    slot = (now + i) & (T2_WHEEL - 1);
+    if (T2_Passes[slot] == 0) continue;
+    cli();
+    passes = T2_Passes[slot];
+    T2_Passes[slot] = 0;
+    sei();
+    id = T2_Head[slot];
+    while (id != T2_NONE) {
+      next = T2_Next[id];       // (the handler may start this timer again)
+      if (T2_Rounds[id] >= passes) {T2_Rounds[id] -= passes;}
+      else {
+        T2_TimerCancel(id);
+        if (id >= T2_TIMER_PULSE) {      // relays_pulse releases the relay (same C_Tick)
+          T2_PulseExpired |= (unsigned int)1 << (id - T2_TIMER_PULSE);
+        }
+        else {T2_Handler[id](id);}
+      }
+      id = next;
+    }
+  }
+}
+
+
+void T2_TimerHandler(unsigned char id, t_T2_handler handler)
+{
+  // sets the function that is called when timer id expires (at initialisation)
+  T2_TimerCancel(id);
+  T2_Handler[id] = handler;
+}
+
+
+//--------------------------------------------------------------------------------------
+//
+// Deadlines
+//
+//--------------------------------------------------------------------------------------
+// T2_Now() is the clock of the decoder: milliseconds since power-up, 32 bits. It is used for
+// all timeouts (service mode, keys, program button) and deadlines.
+// A deadline is a value of T2_Millis. Since T2_Millis wraps, deadlines are compared via the
+// (signed) difference with the current time; this is correct as long as a deadline lies
+// less than 24 days in the past or future.
+// To avoid drift, a periodic action should compute its next deadline by adding the period
+// to its previous deadline, and not to the moment the action was executed.
+
+unsigned long T2_Now(void)
+{
+  // T2_Millis is 4 bytes, so the ISR may change it while it is being read. Instead of disabling
+  // interrupts (which would delay the DCC interrupts), it is read until two reads are equal:
+  // the ISR runs once per ms, so a second try always succeeds.
+  unsigned long now;
+  do {now = T2_Millis;} while (now != T2_Millis);
+  return now;
+}
+
+
+unsigned char T2_Passed(unsigned long deadline)
+{
+  return ((long)(T2_Now() - deadline) >= 0);
+}
+
+
+void T2_WakeAt(unsigned long deadline)
+{
+  // The ISR posts C_Tick (events.c) once T2_Millis reaches the deadline. Only one deadline is
+  // kept: the main loop sets the earliest one after each event.
+  unsigned char sreg;
+  sreg = SREG;
+  cli();
+  T2_Wakeup = deadline;
+  T2_WakeArmed = 1;
+  SREG = sreg;
+}
+
+
+unsigned int T2_Stamp(void)
+{
+  // Time stamp in microseconds (wraps after 65 ms), for short intervals such as the time an
+  // event waits in the queue. It may be called from an ISR: a compare match of which the ISR
+  // did not run yet (interrupts disabled) counts as the next millisecond.
+  unsigned int ms;
+  unsigned char count, sreg;
+  sreg = SREG;
+  cli();
+  ms = (unsigned int) T2_Millis;
+  count = TCNT2;
+  if (TC2_Interrupt_Flag_Register & (1<<TC2_Output_Compare_Flag)) {
+    ms++;
+    count = TCNT2;              // (read again: the counter may just have been cleared)
+  }
+  SREG = sreg;
+  return (ms * 1000) + (((unsigned int)count * (unsigned int)T2_US16_PER_COUNT) >> 4);
+}
+
+
 //--------------------------------------------------------------------------------------
 //
 // Define initialisation routines
@@ -99,6 +311,7 @@ ISR(TC2_Compare_Match_Vect)
 
 void init_timer2(void)
 {
+  unsigned char i;
   // See for example Figure 17-2 in ATMega 16A manual
   // The following registers must be initialized:
   // - Timer/Counter Control Register (TCCR2 / TCCR2A & TCCR2B)
@@ -117,10 +330,8 @@ void init_timer2(void)
   // 7) Initialise a counter to determine if the master is inactive / resets
   // 8) initialise this Timer/Counter
   //
-  // Step 1: Define timer period
-  #define time_microsonds 1000L		// timer fires after 1 ms
-    // Step 2: Determine prescaler
-  #define T2_PRESCALER   256    // may be 1, 8, 32, 64, 128, 256, 1024
+  // Step 1: Define timer period: 1 ms on average (T2_COUNTS and T2_FRAC, see above)
+    // Step 2: Determine prescaler (T2_PRESCALER, see above)
   #if   (T2_PRESCALER==1)
         #define T2_PRESCALER_BITS   ((0<<CS22)|(0<<CS21)|(1<<CS20))
   #elif (T2_PRESCALER==8)
@@ -138,23 +349,32 @@ void init_timer2(void)
   #endif
   // Step 3: Check prescaler
   // Pre-processor check whether timer values are OK for 8 bit
-  // Target Timer Count = (Input Frequency * Target Time / Prescale) - 1 
-  #define T2_target_count (F_CPU / T2_PRESCALER * time_microsonds / 1000000L)
-  #if (T2_target_count > 254)
-    #warning T2_target_count too big, use either larger prescaler or slower processor
+  // Output Compare value = (Input Frequency * Target Time / Prescale) - 1 (T2_TOP)
+  #if (T2_COUNTS > 254)
+    #warning T2_COUNTS too big, use either larger prescaler or slower processor
   #endif
-  #if (T2_target_count < 32)
-    #warning T2_target_count too small, use either smaller prescaler or faster processor
+  #if (T2_COUNTS < 32)
+    #warning T2_COUNTS too small, use either smaller prescaler or faster processor
   #endif
   // Step 4: Initialize the Output Compare Register
-  TC2_Output_Compare_Register = T2_target_count; 
+  TC2_Output_Compare_Register = T2_TOP;
   // Step 5: Enable the Timer/Counter2 Compare Match interrupt
   TC2_Interrupt_Mask_Register |= (1 << TC2_Output_Compare_Match_Interrupt_Enable);
   // Step 6: Initialize the Timer/Counter Control Register
   TC2_Control_Register_A |= (1 << WGM21);          // Configure Timer2 for CTC mode 
   TC2_Control_Register_B |= (T2_PRESCALER_BITS);   // Start Timer2
   // Step 7: Intialise timer specific variable
-  T2_MilliSeconds = 0;
+  T2_Millis = 0;
+  T2_Acc = 0;
+  T2_WakeArmed = 0;
+  T2_Slot = 0;
+  for (i=0; i < T2_WHEEL; i++) {
+    T2_Head[i] = T2_NONE;
+    T2_Passes[i] = 0;
+  }
+  for (i=0; i < T2_TIMERS; i++) {
+    T2_InSlot[i] = T2_NONE;
+  }
   // Step 8: Initialise the Timer/Counter
   TCNT2 = 0;  
 }
@@ -11,7 +11,28 @@
 //
 //--------------------------------------------------------------------------------------
 // Global Data: 
-volatile unsigned char T2_Seconds;			 // Used by relays.c for timing purposes
+extern volatile unsigned long T2_Millis;	 // Milliseconds since power-up (wraps)
+extern unsigned int  T2_PulseExpired;        // Pulse timers that have run out (bit i = relay i)
+
+// Timers on the timer wheel (see timer2.c)
+#define T2_TIMER_LED     0                   // LED flashes (timer_led.c)
+#define T2_TIMER_PROG    1                   // program button (main.c)
+#define T2_TIMER_KEYS    2                   // sampling of the local buttons (keyboard.c)
+#define T2_TIMER_PULSE   3                   // pulse of relay i (relays.c): T2_TIMER_PULSE + i
+#define T2_TIMERS        (T2_TIMER_PULSE + 16)
+
+typedef void (*t_T2_handler)(unsigned char id);
 
 // Hardware initialisation and ISR routines
 void init_timer2(void);
+
+// Deadlines (values of T2_Millis)
+unsigned long T2_Now(void);                  // T2_Millis, read without disabling interrupts
+unsigned char T2_Passed(unsigned long deadline); // 1 if the deadline has been reached
+void T2_WakeAt(unsigned long deadline);      // post C_Tick at the deadline (one deadline)
+unsigned int T2_Stamp(void);                 // microseconds, 16 bits (may be used in an ISR)
+
+void T2_TimerStart(unsigned char id, unsigned int ms);   // (re)start: handler after ms
+void T2_TimerCancel(unsigned char id);
+void T2_TimerHandler(unsigned char id, t_T2_handler handler); // not for the pulse timers
+void T2_TimerRun(void);                      // main loop (C_Tick): calls the expired handlers
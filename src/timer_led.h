@@ -17,7 +17,7 @@
 //
 //------------------------------------------------------------------------
 
-void init_timer1(void);
+void init_timer_led(void);                    // after init_timer2()
 
 void turn_led_on(void);
   
@@ -0,0 +1,16 @@
+//------------------------------------------------------------------------
+//
+// file:      test/host/avr/cpufunc.h
+//
+// purpose:   Stand-in for <avr/cpufunc.h>, to compile the decoder sources on a PC
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at http://www.gnu.org/licenses/gpl.txt
+//
+//------------------------------------------------------------------------
+#ifndef _HOST_AVR_CPUFUNC_H_
+#define _HOST_AVR_CPUFUNC_H_
+
+#define _NOP()  do {} while (0)
+
+#endif
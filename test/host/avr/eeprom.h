@@ -0,0 +1,30 @@
+//------------------------------------------------------------------------
+//
+// file:      test/host/avr/eeprom.h
+//
+// purpose:   Stand-in for <avr/eeprom.h>, to compile the decoder sources on a PC
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at http://www.gnu.org/licenses/gpl.txt
+//
+//------------------------------------------------------------------------
+//
+// EEMEM variables (the CV struct of config.c) are plain RAM on the PC; the access functions
+// of host.c read and write them through their address, and can simulate a power failure
+// before a write (HostCut, see host.h).
+//
+//------------------------------------------------------------------------
+#ifndef _HOST_AVR_EEPROM_H_
+#define _HOST_AVR_EEPROM_H_
+
+#include <stdint.h>
+
+#define EEMEM
+
+uint8_t eeprom_read_byte(const uint8_t *p);
+void eeprom_write_byte(uint8_t *p, uint8_t value);
+
+#define eeprom_is_ready()   1
+#define eeprom_busy_wait()  do {} while (0)
+
+#endif
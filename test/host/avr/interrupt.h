@@ -0,0 +1,27 @@
+//------------------------------------------------------------------------
+//
+// file:      test/host/avr/interrupt.h
+//
+// purpose:   Stand-in for <avr/interrupt.h>, to compile the decoder sources on a PC
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at http://www.gnu.org/licenses/gpl.txt
+//
+//------------------------------------------------------------------------
+//
+// An ISR is an ordinary function named after its vector (e.g. TIMER2_COMP_vect), which a
+// test calls to simulate the interrupt. There is no concurrency on the PC, so sei() and
+// cli() do nothing.
+//
+//------------------------------------------------------------------------
+#ifndef _HOST_AVR_INTERRUPT_H_
+#define _HOST_AVR_INTERRUPT_H_
+
+#define ISR(vector, ...)  void vector(void); void vector(void)
+#define ISR_NOBLOCK
+#define ISR_NAKED
+
+#define sei()  do {} while (0)
+#define cli()  do {} while (0)
+
+#endif
@@ -0,0 +1,129 @@
+//------------------------------------------------------------------------
+//
+// file:      test/host/avr/io.h
+//
+// purpose:   Stand-in for <avr/io.h>, to compile the decoder sources on a PC
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at http://www.gnu.org/licenses/gpl.txt
+//
+//------------------------------------------------------------------------
+//
+// The I/O registers of the ATmega16 (the default MCU of the Makefile) as plain variables,
+// defined in host.c. The host tests are compiled with __AVR_ATmega16__, so hardware.h and
+// the sources take the paths of the ATmega8535/16/32.
+//
+//------------------------------------------------------------------------
+#ifndef _HOST_AVR_IO_H_
+#define _HOST_AVR_IO_H_
+
+#include <stdint.h>
+
+extern volatile uint8_t PORTA, PORTB, PORTC, PORTD;
+extern volatile uint8_t PINA, PINB, PINC, PIND;
+extern volatile uint8_t DDRA, DDRB, DDRC, DDRD;
+extern volatile uint8_t TCCR0, TCNT0, TCCR1A, TCCR1B, TCCR2, TCNT2, OCR2;
+extern volatile uint16_t TCNT1, OCR1A, OCR1B, ICR1;
+extern volatile uint8_t TIMSK, TIFR, GICR, GIFR, MCUCR, MCUCSR, SFIOR;
+extern volatile uint8_t ACSR, SPCR, SPSR, SPDR;
+extern volatile uint8_t EECR, EEDR;
+extern volatile uint16_t EEAR;
+extern volatile uint8_t SREG;
+
+#define _SFR_IO_ADDR(reg)  0
+#define E2END   511             // last EEPROM address (512 bytes)
+
+// TCCR0
+#define FOC0    7
+#define WGM00   6
+#define COM01   5
+#define COM00   4
+#define WGM01   3
+#define CS02    2
+#define CS01    1
+#define CS00    0
+
+// TCCR1A / TCCR1B
+#define COM1A1  7
+#define COM1A0  6
+#define COM1B1  5
+#define COM1B0  4
+#define WGM11   1
+#define WGM10   0
+#define ICNC1   7
+#define ICES1   6
+#define WGM13   4
+#define WGM12   3
+#define CS12    2
+#define CS11    1
+#define CS10    0
+
+// TCCR2
+#define WGM20   6
+#define COM21   5
+#define COM20   4
+#define WGM21   3
+#define CS22    2
+#define CS21    1
+#define CS20    0
+
+// TIMSK / TIFR
+#define OCIE2   7
+#define TOIE2   6
+#define TICIE1  5
+#define OCIE1A  4
+#define OCIE1B  3
+#define TOIE1   2
+#define OCIE0   1
+#define TOIE0   0
+#define OCF2    7
+#define TOV2    6
+#define ICF1    5
+#define OCF1A   4
+#define OCF1B   3
+#define TOV1    2
+#define OCF0    1
+#define TOV0    0
+
+// GICR / MCUCR
+#define INT1    7
+#define INT0    6
+#define INT2    5
+#define SM2     7
+#define SE      6
+#define SM1     5
+#define SM0     4
+#define ISC11   3
+#define ISC10   2
+#define ISC01   1
+#define ISC00   0
+
+// ACSR
+#define ACD     7
+#define ACBG    6
+#define ACO     5
+#define ACI     4
+#define ACIE    3
+#define ACIC    2
+#define ACIS1   1
+#define ACIS0   0
+
+// SPCR / SPSR
+#define SPIE    7
+#define SPE     6
+#define DORD    5
+#define MSTR    4
+#define CPOL    3
+#define CPHA    2
+#define SPR1    1
+#define SPR0    0
+#define SPIF    7
+#define SPI2X   0
+
+// EECR
+#define EERIE   3
+#define EEMWE   2
+#define EEWE    1
+#define EERE    0
+
+#endif
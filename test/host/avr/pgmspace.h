@@ -0,0 +1,21 @@
+//------------------------------------------------------------------------
+//
+// file:      test/host/avr/pgmspace.h
+//
+// purpose:   Stand-in for <avr/pgmspace.h>, to compile the decoder sources on a PC
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at http://www.gnu.org/licenses/gpl.txt
+//
+//------------------------------------------------------------------------
+#ifndef _HOST_AVR_PGMSPACE_H_
+#define _HOST_AVR_PGMSPACE_H_
+
+#include <stdint.h>
+
+#define PROGMEM
+
+#define pgm_read_byte(addr)   (*(const uint8_t *)(addr))
+#define pgm_read_word(addr)   (*(const uint16_t *)(addr))
+
+#endif
@@ -0,0 +1,25 @@
+//------------------------------------------------------------------------
+//
+// file:      test/host/avr/sleep.h
+//
+// purpose:   Stand-in for <avr/sleep.h>, to compile the decoder sources on a PC
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at http://www.gnu.org/licenses/gpl.txt
+//
+//------------------------------------------------------------------------
+//
+// Sleeping does nothing: a test posts the events itself and calls the dispatcher again.
+//
+//------------------------------------------------------------------------
+#ifndef _HOST_AVR_SLEEP_H_
+#define _HOST_AVR_SLEEP_H_
+
+#define SLEEP_MODE_IDLE       0
+
+#define set_sleep_mode(mode)  do {} while (0)
+#define sleep_enable()        do {} while (0)
+#define sleep_disable()       do {} while (0)
+#define sleep_cpu()           do {} while (0)
+
+#endif
@@ -0,0 +1,98 @@
+//------------------------------------------------------------------------
+//
+// file:      test/host/host.c
+//
+// purpose:   The PC side of the host tests: registers, EEPROM and time
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at http://www.gnu.org/licenses/gpl.txt
+//
+//------------------------------------------------------------------------
+//
+// The host tests (make host-test in src) compile relays.c, timer2.c, events.c, config.c and
+// myeeprom.c with gcc for the PC, with the stand-ins for the avr-libc headers in this
+// directory and the recording output driver of output_host.c instead of bam.c and sr.c.
+// Each test_*.c is a main program that calls the decoder functions and the ISRs directly,
+// and checks the results with CHECK(); it exits with 1 if a check failed.
+// The CV struct (EEMEM) is ordinary RAM here. To test the behaviour at power failure, a test
+// sets HostCut to the number of EEPROM writes that still succeed; the next write then jumps
+// back to HostReset instead, as if the supply failed at that moment. Busy waiting (_mydelay_us)
+// calls HostDelay with the number of loops of 4 CPU cycles, if a test set it.
+//
+//------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdint.h>
+#include <setjmp.h>
+#include <avr/io.h>
+#include <avr/eeprom.h>
+
+#include "host.h"
+
+volatile uint8_t PORTA, PORTB, PORTC, PORTD;
+volatile uint8_t PINA, PINB, PINC, PIND;
+volatile uint8_t DDRA, DDRB, DDRC, DDRD;
+volatile uint8_t TCCR0, TCNT0, TCCR1A, TCCR1B, TCCR2, TCNT2, OCR2;
+volatile uint16_t TCNT1, OCR1A, OCR1B, ICR1;
+volatile uint8_t TIMSK, TIFR, GICR, GIFR, MCUCR, MCUCSR, SFIOR;
+volatile uint8_t ACSR, SPCR, SPSR, SPDR;
+volatile uint8_t EECR, EEDR;
+volatile uint16_t EEAR;
+volatile uint8_t SREG;
+
+jmp_buf HostReset;
+long HostCut = -1;
+unsigned long HostWrites;
+unsigned long HostReads;
+void (*HostDelay)(unsigned int loops);
+
+static unsigned int Checks;
+static unsigned int Failures;
+
+void TIMER2_COMP_vect(void);     // the ISR of timer2.c (ATmega16)
+
+
+uint8_t eeprom_read_byte(const uint8_t *p)
+{
+  HostReads++;
+  return *p;
+}
+
+
+void eeprom_write_byte(uint8_t *p, uint8_t value)
+{
+  if (HostCut == 0) {
+    HostCut = -1;
+    longjmp(HostReset, HOST_CUT);
+  }
+  if (HostCut > 0) {HostCut--;}
+  HostWrites++;
+  *p = value;
+}
+
+
+void _restart(void)
+{ // config.h: jumps to the reset vector on the decoder
+  longjmp(HostReset, HOST_RESTART);
+}
+
+
+void host_ms(unsigned long ms)
+{
+  while (ms--) {TIMER2_COMP_vect();}
+}
+
+
+void host_check(int ok, const char *text, const char *file, int line)
+{
+  Checks++;
+  if (ok) return;
+  Failures++;
+  printf("%s:%d: check failed: %s\n", file, line, text);
+}
+
+
+int host_result(const char *test)
+{
+  printf("%s: %u checks, %u failed\n", test, Checks, Failures);
+  return Failures ? 1 : 0;
+}
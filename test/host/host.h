@@ -0,0 +1,30 @@
+//------------------------------------------------------------------------
+//
+// file:      test/host/host.h
+//
+// purpose:   Support functions of the host tests (see host.c)
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at http://www.gnu.org/licenses/gpl.txt
+//
+//------------------------------------------------------------------------
+#ifndef _HOST_H_
+#define _HOST_H_
+
+#include <setjmp.h>
+
+#define HOST_CUT      1          // longjmp value: the supply failed before an EEPROM write
+#define HOST_RESTART  2          // longjmp value: the firmware called _restart()
+
+extern jmp_buf HostReset;        // where a power failure or _restart() continues
+extern long HostCut;             // EEPROM writes until the supply fails (-1: never)
+extern unsigned long HostWrites; // EEPROM writes since the start of the test
+extern unsigned long HostReads;  // EEPROM reads since the start of the test
+
+void host_ms(unsigned long ms);  // advance the virtual time: one Timer2 ISR per ms
+
+#define CHECK(cond)  host_check((cond) != 0, #cond, __FILE__, __LINE__)
+void host_check(int ok, const char *text, const char *file, int line);
+int host_result(const char *test);   // prints the summary, returns the exit code of main
+
+#endif
@@ -0,0 +1,72 @@
+//------------------------------------------------------------------------
+//
+// file:      test/host/test_bam.c
+//
+// purpose:   Compare ISR of bam.c (Timer1): a late ISR may not lose the next compare
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at http://www.gnu.org/licenses/gpl.txt
+//
+//------------------------------------------------------------------------
+//
+// Timer1 runs free; each compare match calls the ISR, which sets OCR1A for the next slice.
+// The test calls the ISR a number of counts after each compare match (interrupt latency),
+// also longer than the shortest slices. After the ISR, OCR1A must lie ahead of TCNT1 (else
+// the next match only comes after Timer1 wrapped), and the slices must keep their places:
+// the end of slice k of period p lies (p * 255 + 2^(k+1) - 1) * BAM_UNIT counts after the
+// start, also if the ISR had to skip some slices.
+//
+//------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdint.h>
+#include <avr/pgmspace.h>
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+
+#include "config.h"
+#include "bam.h"
+#include "host.h"
+
+#define BAM_BITS    8            // as bam.c
+#define BAM_UNIT    40
+#define BAM_MARGIN  16
+#define PERIODS     20
+
+void TIMER1_COMPA_vect(void);
+extern volatile unsigned char BamBit;
+
+static void test_latency(unsigned int latency)
+{ // latency: counts between the compare match and the (first read of TCNT1 in the) ISR
+  unsigned int start, end, lost, drift, periods;
+  unsigned char bit;
+  init_bam();
+  bam_set_level(0, 0x55);        // Timer1 runs, the first period starts at OCR1A
+  start = OCR1A;
+  lost = 0;
+  drift = 0;
+  periods = 0;
+  bit = 0xFF;
+  while (periods < PERIODS) {
+    TCNT1 = OCR1A + latency;     // the compare matched latency counts ago
+    TIMER1_COMPA_vect();
+    if ((int16_t)(OCR1A - TCNT1) < BAM_MARGIN) {lost++;}
+    if (bit != 0xFF && BamBit <= bit) {periods++;}   // the ISR passed the end of a period
+    bit = BamBit;
+    end = (periods * 255U + (2U << bit) - 1) * BAM_UNIT;
+    if ((uint16_t)(OCR1A - start) != (uint16_t)end) {drift++;}
+  }
+  printf("latency %u counts: %u compares lost, %u slices misplaced\n", latency, lost, drift);
+  CHECK(lost == 0);
+  CHECK(drift == 0);
+}
+
+int main(void)
+{
+  test_latency(0);
+  test_latency(30);              // longer than the margin after slice 0
+  test_latency(60);              // longer than slice 0
+  test_latency(150);             // longer than slices 0-1
+  test_latency(700);             // longer than slices 0-3
+  return host_result("test_bam");
+}
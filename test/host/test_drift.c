@@ -0,0 +1,67 @@
+//------------------------------------------------------------------------
+//
+// file:      test/host/test_drift.c
+//
+// purpose:   Drift of the 1 ms tick of timer2.c for the crystal in F_CPU
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at http://www.gnu.org/licenses/gpl.txt
+//
+//------------------------------------------------------------------------
+//
+// Simulates Timer2 in CTC mode: each period lasts OCR2 + 1 counts of F_CPU / prescaler, and
+// the ISR sets OCR2 for the period that follows. After 24 hours of T2_Millis the real time
+// passed may differ less than 10 ppm (in fact it should be 0), and T2_Millis may never be
+// more than 2 counts ahead or behind. The Makefile builds this test for the crystal in XTAL
+// and each crystal in HOST_XTALS.
+//
+//------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <avr/pgmspace.h>
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+
+#include "config.h"
+#include "timer2.h"
+#include "host.h"
+
+#define HOURS   24
+
+static const unsigned int Prescaler[8] = {0, 1, 8, 32, 64, 128, 256, 1024};
+
+int main(void)
+{
+  unsigned long ms;
+  unsigned long long counts;     // Timer2 counts passed
+  unsigned long long expected;   // counts of ms milliseconds, times 1000
+  unsigned int prescaler, period;
+  long long phase, worst;
+  double ppm;
+  char name[32];
+
+  init_timer2();
+  prescaler = Prescaler[TCCR2 & ((1<<CS22) | (1<<CS21) | (1<<CS20))];
+  CHECK(prescaler != 0);
+  if (prescaler == 0) {return host_result("test_drift");}
+  counts = 0;
+  worst = 0;
+  period = OCR2 + 1;
+  for (ms=1; ms <= HOURS * 3600000UL; ms++) {
+    counts += period;            // the compare match: the ISR programs the next period
+    host_ms(1);
+    period = OCR2 + 1;
+    // phase error in 1/1000 count: counts - ms * F_CPU / (prescaler * 1000)
+    expected = (unsigned long long) ms * F_CPU / prescaler;
+    phase = (long long) (counts * 1000) - (long long) expected;
+    if (llabs(phase) > worst) {worst = llabs(phase);}
+  }
+  ppm = ((double) counts * prescaler / F_CPU - HOURS * 3600.0) / (HOURS * 3600.0) * 1e6;
+  printf("%lu Hz: drift %.3f ppm, phase error at most %.3f counts after %u hours\n",
+         (unsigned long) F_CPU, ppm, worst / 1000.0, HOURS);
+  CHECK(ppm < 10.0 && ppm > -10.0);
+  CHECK(worst <= 2000);
+  sprintf(name, "test_drift (%lu Hz)", (unsigned long) F_CPU);
+  return host_result(name);
+}
@@ -0,0 +1,190 @@
+//------------------------------------------------------------------------
+//
+// file:      test/host/test_events.c
+//
+// purpose:   Order of the events handled by event_dispatch (events.c)
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at http://www.gnu.org/licenses/gpl.txt
+//
+//------------------------------------------------------------------------
+//
+// Each handler appends a letter to a trace. With all events pending, one dispatch per event
+// must handle them by priority; an event posted by a handler must overtake the events of
+// lower priority that still wait; posting an event that is pending has no effect; and the
+// flag C_DoSave, which has no handler, is never dispatched.
+// The program button (ATmega16: input capture on PD6) must post C_Button once per press, also
+// if it bounces, and may only be armed again after it was released for 20 ms.
+//
+//------------------------------------------------------------------------
+#include <stdio.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+
+#include "config.h"
+#include "hardware.h"
+#include "timer2.h"
+#include "events.h"
+#include "host.h"
+
+static char Trace[64];
+static unsigned char TraceLen;
+
+static void trace(char c)
+{
+  if (TraceLen < sizeof(Trace) - 1) {Trace[TraceLen++] = c;}
+  Trace[TraceLen] = 0;
+}
+
+static void ev_received(void)
+{
+  Communicate &= ~(1<<C_Received);           // as analyze_message: the packet is used
+  trace('R');
+}
+
+static void ev_button(void)  {trace('B');}
+static void ev_keys(void)    {trace('K');}
+static void ev_written(void) {trace('V');}
+static void ev_eeprom(void)  {trace('E');}
+static void ev_save(void)    {trace('S');}
+
+static void ev_tick(void)
+{ // the first tick posts a packet and a save, as an ISR and a relays task could
+  trace('T');
+  if (Trace[0] == 'T') {
+    event_post(C_Received);
+    event_post(C_Save);
+  }
+}
+
+static void post_all(void)
+{
+  event_post(C_Save);
+  event_post(C_Eeprom);
+  event_post(C_Tick);
+  event_post(C_CvWritten);
+  event_post(C_Keys);
+  event_post(C_Button);
+  event_post(C_Received);
+  event_post(C_Received);                    // twice: still one event
+}
+
+static void dispatch(unsigned char n)
+{
+  TraceLen = 0;
+  Trace[0] = 0;
+  while (n--) {event_dispatch();}
+}
+
+void TIMER1_CAPT_vect(void);
+
+static void button(unsigned char pressed)
+{ // sets PROGTASTER; a falling edge sets ICF1, which calls the ISR if it is enabled
+  if (pressed && (PIND & (1<<PROGTASTER))) {
+    TIFR |= (1<<ICF1);
+    if (TIMSK & (1<<TICIE1)) {
+      TIFR &= ~(1<<ICF1);
+      TIMER1_CAPT_vect();
+    }
+  }
+  if (pressed) {PIND &= ~(1<<PROGTASTER);}
+  else         {PIND |= (1<<PROGTASTER);}
+}
+
+static unsigned char presses(void)
+{ // 1 if C_Button was posted since the last call
+  unsigned char posted;
+  posted = (Communicate & (1<<C_Button)) != 0;
+  Communicate &= ~(1<<C_Button);
+  return posted;
+}
+
+static void test_button(void)
+{
+  unsigned char i;
+  PIND = 0;                                  // pressed at power up
+  TIMSK = 0;
+  init_events();
+  host_ms(100);
+  CHECK(presses() == 0);
+  button(0);
+  host_ms(19);
+  CHECK((TIMSK & (1<<TICIE1)) == 0);         // released for 19 ms: not yet armed
+  host_ms(1);
+  CHECK(TIMSK & (1<<TICIE1));
+  for (i=0; i < 6; i++) {                    // press, bouncing
+    button(1);
+    host_ms(1);
+    button(0);
+    host_ms(2);
+  }
+  button(1);
+  host_ms(500);
+  CHECK(presses() == 1);
+  CHECK((TIMSK & (1<<TICIE1)) == 0);
+  for (i=0; i < 6; i++) {                    // release, bouncing
+    button(0);
+    host_ms(2);
+    button(1);
+    host_ms(1);
+  }
+  button(0);
+  host_ms(19);
+  CHECK((TIMSK & (1<<TICIE1)) == 0);
+  host_ms(1);
+  CHECK(TIMSK & (1<<TICIE1));
+  CHECK(presses() == 0);
+  button(1);                                 // the next press
+  CHECK(presses() == 1);
+  button(0);
+}
+
+int main(void)
+{
+  init_timer2();
+  init_events();
+  event_handler(C_Received, ev_received);
+  event_handler(C_Button, ev_button);
+  event_handler(C_Keys, ev_keys);
+  event_handler(C_CvWritten, ev_written);
+  event_handler(C_Tick, ev_tick);
+  event_handler(C_Eeprom, ev_eeprom);
+  event_handler(C_Save, ev_save);
+
+  // all events pending: strict priority order, one event per dispatch
+  Communicate = 0;
+  post_all();
+  dispatch(7);
+  printf("all pending: %s\n", Trace);
+  CHECK(strcmp(Trace, "RBKVTES") == 0);
+  CHECK(Communicate == 0);
+
+  // a handler posts a packet: it is handled before the events that were already waiting
+  event_post(C_Eeprom);
+  event_post(C_Tick);
+  dispatch(4);
+  printf("posted by a handler: %s\n", Trace);
+  CHECK(strcmp(Trace, "TRES") == 0);
+  CHECK(Communicate == 0);
+
+  // C_DoSave is a flag, not an event: it is neither dispatched nor cleared
+  Communicate = (1<<C_DoSave);
+  event_post(C_Save);
+  dispatch(1);
+  CHECK(strcmp(Trace, "S") == 0);
+  CHECK(Communicate == (1<<C_DoSave));
+
+  #if (EVENT_STATS == TRUE)
+  // the statistics count every dispatch
+  CHECK(EventCount[C_Received] == 2);
+  CHECK(EventCount[C_Tick] == 2);
+  CHECK(EventCount[C_Save] == 3);
+  CHECK(EventCount[C_DoSave] == 0);
+  #endif
+
+  test_button();
+  return host_result("test_events");
+}
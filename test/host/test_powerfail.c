@@ -0,0 +1,198 @@
+//------------------------------------------------------------------------
+//
+// file:      test/host/test_powerfail.c
+//
+// purpose:   Cuts the supply at random moments and checks the restored relay state
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at http://www.gnu.org/licenses/gpl.txt
+//
+//------------------------------------------------------------------------
+//
+// CV544 = 1: the state log is written in the background; the supply fails after a random
+//            number of EEPROM writes, possibly in the middle of a record.
+// CV544 = 2: the comparator ISR writes the record when the supply drops; the supply fails
+//            after a random number of its writes, possibly while the next slot is still
+//            being erased (armed) in the background.
+// After each power-up the relays must show either the newest state or the state restored
+// at the previous power-up, never anything else.
+// First save: the CVs as shipped (CV_PRESET, no record in the log), the supply fails after
+// each of the writes of the first record; the relays must be all off or in the new state.
+// Dips: CV544 = 2, the supply drops for a short time only. Dips shorter than the filter of
+// the comparator ISR (100 us) neither save nor restart; a longer one does both.
+//
+//------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+
+#include "config.h"
+#include "timer2.h"
+#include "output.h"
+#include "relays.h"
+#include "host.h"
+
+#define CUTS  2000               // power failures per mode
+
+extern t_cv_record CV;
+extern const t_cv_record CV_PRESET;
+extern unsigned char PreviousCommand;
+
+void ANA_COMP_vect(void);        // the power-fail ISR of relays.c (ATmega16)
+
+static unsigned long SupplyLow;  // loops of busy waiting until the supply is back
+
+static void run(unsigned long ms)
+{ // the relays tasks of the main loop, once per ms
+  while (ms--) {
+    host_ms(1);
+    relays_schedule();
+    relays_save();
+  }
+}
+
+static void supply(unsigned int loops)
+{ // HostDelay: the comparator output (ACO) is high while the supply is low
+  if (SupplyLow > loops) {
+    SupplyLow -= loops;
+    return;
+  }
+  SupplyLow = 0;
+  ACSR &= ~(1<<ACO);
+}
+
+static void supply_drops(unsigned int us)
+{ // the supply drops below the threshold for us (4 CPU cycles per loop of busy waiting)
+  SupplyLow = (unsigned long)(us * (F_CPU / 4e6));
+  ACSR |= (1<<ACO);
+  ANA_COMP_vect();
+}
+
+static void power_up(void)
+{
+  T2_Millis = 0;
+  OutA = 0;
+  OutC = 0;
+  init_timer2();
+  init_relays_actions();
+}
+
+static void setup(unsigned char state_save)
+{ // the CVs of the tests: mode 2, no delays, no pulses
+  memcpy(&CV, &CV_PRESET, sizeof(CV));
+  CV.Ract = 1;
+  CV.Mode = 2;
+  CV.ModeL = 255;
+  CV.ModeH = 255;
+  CV.RMaxOn = 0;
+  CV.RBreak = 0;
+  CV.RPulseL = 0;
+  CV.RPulseH = 0;
+  CV.LastState = state_save;
+}
+
+static void test_mode(unsigned char state_save)
+{
+  unsigned int i, newest, previous, wrong;
+  unsigned char oldA, oldC, newA, newC, relay;
+  setup(state_save);
+  newest = previous = wrong = 0;
+  power_up();
+  for (i=0; i < CUTS; i++) {
+    oldA = OutA;                                 // the state after the last power-up
+    oldC = OutC;
+    relay = rand() % 16;
+    relays_actions((relay << 1) | (rand() & 1));
+    run(5);                                      // scheduler: the relay is set
+    newA = OutA;
+    newC = OutC;
+    if (state_save == 1) {
+      run(1000 + rand() % 1500);                 // the save may have started, or not
+      HostCut = rand() % 7;
+      if (setjmp(HostReset) == 0) {run(10);}     // any writes left are cut
+      HostCut = -1;
+    }
+    else {
+      run(rand() % 20);                          // arming may still be busy
+      HostCut = rand() % 7;
+      if (setjmp(HostReset) == 0) {supply_drops(1000);}
+      HostCut = -1;
+    }
+    power_up();
+    if ((OutA == newA) && (OutC == newC)) {newest++;}
+    else if ((OutA == oldA) && (OutC == oldC)) {previous++;}
+    else {wrong++;}
+    PreviousCommand = 0xFF;                      // the next command is never a repetition
+  }
+  printf("CV544 = %u: restored the newest state %u times, the previous state %u times, "
+         "wrong %u times\n", state_save, newest, previous, wrong);
+  CHECK(wrong == 0);
+  CHECK(newest > 0);
+  CHECK(previous > 0);
+}
+
+static void test_first(unsigned char state_save)
+{ // the first save after a reset to CV_PRESET, cut after each of its writes
+  unsigned char cut, newA, newC;
+  for (cut=0; cut <= sizeof(t_state_record); cut++) {
+    setup(state_save);
+    power_up();
+    relays_actions((5 << 1) | 1);                // relay 6 on
+    run(5);
+    newA = OutA;
+    newC = OutC;
+    HostCut = cut;
+    if (setjmp(HostReset) == 0) {
+      if (state_save == 1) {run(3000);}
+      else {supply_drops(1000);}
+    }
+    HostCut = -1;
+    power_up();
+    if (cut < sizeof(t_state_record)) {          // (unchanged bytes are not written)
+      CHECK(((OutA == 0) && (OutC == 0)) || ((OutA == newA) && (OutC == newC)));
+    }
+    else {CHECK((OutA == newA) && (OutC == newC));}
+  }
+}
+
+static void test_dip(unsigned int us, unsigned char saved)
+{ // CV544 = 2: the supply drops for us; saved: a record is written (and the decoder restarts)
+  unsigned char setA, setC;
+  unsigned long writes;
+  volatile unsigned char restarted = 0;
+  setup(2);
+  power_up();
+  relays_actions((2 << 1) | 1);                  // relay 3 on
+  run(50);
+  setA = OutA;
+  setC = OutC;
+  writes = HostWrites;
+  if (setjmp(HostReset) == 0) {supply_drops(us);}
+  else {restarted = 1;}
+  printf("dip of %u us: %lu EEPROM writes, %s\n", us, HostWrites - writes,
+         restarted ? "restarted" : "relays kept");
+  CHECK(restarted == saved);
+  CHECK(HostWrites - writes == (saved ? sizeof(t_state_record) : 0));
+  if (restarted) {power_up();}
+  CHECK((OutA == setA) && (OutC == setC));
+}
+
+int main(void)
+{
+  srand(1);
+  OutLog = fopen("/dev/null", "w");              // only the state matters here
+  HostDelay = supply;
+  test_mode(1);
+  test_mode(2);
+  test_first(1);
+  test_first(2);
+  test_dip(10, 0);
+  test_dip(50, 0);
+  test_dip(90, 0);
+  test_dip(150, 1);
+  return host_result("test_powerfail");
+}
@@ -0,0 +1,123 @@
+//------------------------------------------------------------------------
+//
+// file:      test/host/test_ranges.c
+//
+// purpose:   Binary state range table: mapping and lookup throughput
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at http://www.gnu.org/licenses/gpl.txt
+//
+//------------------------------------------------------------------------
+//
+// relays_binary_state is called for every binary state packet to the decoder's multifunction
+// address, so its lookup must be fast and may not read the EEPROM (the table is copied to
+// RAM by init_bs_ranges). The test checks the mapping of the range boundaries, then runs
+// all 32767 binary state numbers many times and reports the lookups per second.
+//
+//------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <avr/pgmspace.h>
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+
+#include "config.h"
+#include "timer2.h"
+#include "output.h"
+#include "relays.h"
+#include "host.h"
+
+#define PASSES  100              // times all binary states are looked up
+
+extern t_cv_record CV;
+extern const t_cv_record CV_PRESET;
+extern unsigned char PreviousCommand;
+extern unsigned char ShadowA, ShadowC;
+
+static void range(unsigned char i, unsigned int first, unsigned char count, unsigned char relay)
+{
+  CV.BSRange[i].FirstL = first & 0xFF;
+  CV.BSRange[i].FirstH = first >> 8;
+  CV.BSRange[i].Count = count;
+  CV.BSRange[i].Relay = relay;
+}
+
+static unsigned int relays_on(void)
+{ // relays 1-16 as one pattern (bit 0 = relay 1); relays 9-16 are in PORTA order
+  unsigned char i, a;
+  a = 0;
+  for (i=0; i < 8; i++) {
+    if (OutA & (0x80 >> i)) {a |= 1 << i;}
+  }
+  return OutC | (a << 8);
+}
+
+static unsigned int switch_on(unsigned int state)
+{ // the relays that are on after binary state "on" (and nothing else)
+  ShadowA = 0;
+  ShadowC = 0;
+  OutA = 0;
+  OutC = 0;
+  PreviousCommand = 0xFF;
+  relays_binary_state(state, 1);
+  relays_schedule();
+  return relays_on();
+}
+
+int main(void)
+{
+  unsigned long lookups, reads;
+  unsigned int state, pass;
+  clock_t start;
+  double seconds;
+
+  memcpy(&CV, &CV_PRESET, sizeof(CV));
+  CV.Ract = 1;
+  CV.Mode = 2;                                   // relays independent
+  CV.ModeL = 255;
+  CV.ModeH = 255;
+  CV.RMaxOn = 0;
+  CV.RBreak = 0;
+  CV.RPulseL = 0;
+  CV.RPulseH = 0;
+  CV.LastState = 0;
+  range(0, 100, 4, 1);                           // 100..103 => relays 1-4
+  range(1, 32000, 8, 5);                         // 32000..32007 => relays 5-12
+  range(2, 1, 5, 15);                            // 1..2 => relays 15-16 (count is limited)
+  range(3, 0, 0, 1);                             // not used
+  OutLog = fopen("/dev/null", "w");
+  init_timer2();
+  init_relays_actions();
+
+  CHECK(switch_on(0) == 0);                      // broadcast: ignored
+  CHECK(switch_on(1) == 0x4000);
+  CHECK(switch_on(2) == 0x8000);
+  CHECK(switch_on(3) == 0);                      // beyond relay 16
+  CHECK(switch_on(99) == 0);
+  CHECK(switch_on(100) == 0x0001);
+  CHECK(switch_on(103) == 0x0008);
+  CHECK(switch_on(104) == 0);
+  CHECK(switch_on(31999) == 0);
+  CHECK(switch_on(32000) == 0x0010);
+  CHECK(switch_on(32007) == 0x0800);
+  CHECK(switch_on(32008) == 0);
+  CHECK(switch_on(32767) == 0);
+
+  reads = HostReads;
+  lookups = 0;
+  start = clock();
+  for (pass=0; pass < PASSES; pass++) {
+    for (state=1; state < 32768; state++) {
+      relays_binary_state(state, pass & 1);
+      lookups++;
+    }
+  }
+  seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+  printf("%lu lookups in %.3f s: %.1f million per second (PC)\n", lookups, seconds,
+         seconds > 0 ? lookups / seconds / 1e6 : 0.0);
+  CHECK(HostReads == reads);                     // the table is in RAM
+  return host_result("test_ranges");
+}
@@ -0,0 +1,334 @@
+//------------------------------------------------------------------------
+//
+// file:      test/host/test_relays.c
+//
+// purpose:   Runs relay commands through relays.c and checks the output log
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at http://www.gnu.org/licenses/gpl.txt
+//
+//------------------------------------------------------------------------
+//
+// Each case sets the CVs, sends commands as the DCC decoder would (relays_actions), runs
+// the main loop tasks for a number of ms of virtual time and compares the log of the
+// recording output driver (output_host.c) with the expected writes. The log starts at
+// init_relays_actions, the time is T2_Millis since the start of the case.
+//
+//------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+
+#include "config.h"
+#include "timer2.h"
+#include "output.h"
+#include "relays.h"
+#include "host.h"
+
+extern t_cv_record CV;
+extern const t_cv_record CV_PRESET;
+
+static char *Log;
+static size_t LogSize;
+
+static void run(unsigned long ms)
+{ // the relays tasks of the main loop (ev_tick in main.c), once per ms
+  while (ms--) {
+    host_ms(1);
+    T2_TimerRun();
+    relays_round_robin();
+    relays_sequencer();
+    relays_schedule();
+    relays_pulse();
+  }
+}
+
+static unsigned int run_counting(unsigned long ms)
+{ // as run, with the saving of the switching cycles; returns the number of flushes started
+  unsigned int flushes = 0;
+  unsigned char busy;
+  while (ms--) {
+    run(1);
+    busy = relays_save_busy();
+    relays_count_save();
+    if (!busy && relays_save_busy()) {flushes++;}
+  }
+  return flushes;
+}
+
+static void command(unsigned char relay, unsigned char activate)
+{ // relay 1..16, as received via DCC (CV532 = 1: activate with +)
+  relays_actions(((relay - 1) << 1) | (activate ? 1 : 0));
+}
+
+static void start(void)
+{ // power-up with the CVs set by the case
+  T2_Millis = 0;
+  OutA = 0;
+  OutC = 0;
+  init_timer2();
+  OutLog = open_memstream(&Log, &LogSize);
+  init_relays_actions();
+}
+
+static void expect(const char *name, const char *expected)
+{
+  fclose(OutLog);
+  OutLog = NULL;
+  if (strcmp(Log, expected) != 0) {
+    printf("%s: expected\n%sgot\n%s", name, expected, Log);
+  }
+  CHECK(strcmp(Log, expected) == 0);
+  free(Log);
+}
+
+static void defaults(void)
+{
+  memcpy(&CV, &CV_PRESET, sizeof(CV));
+  CV.Ract = 1;
+  CV.RBreak = 0;
+  CV.RMaxOn = 0;
+  CV.RSlice = 1;
+  CV.LastState = 0;
+  CV.ModeL = 255;                // both blocks as CV536
+  CV.ModeH = 255;
+}
+
+int main(void)
+{
+  unsigned long i;
+  unsigned int flushes;
+
+  // mode 2: each relay independently
+  defaults();
+  CV.Mode = 2;
+  start();
+  command(1, 1); run(5);
+  command(2, 1); run(5);
+  command(9, 1); run(5);
+  command(1, 0); run(5);
+  expect("mode 2",
+         "0 C 01\n"
+         "5 C 03\n"
+         "10 A 80\n"
+         "15 A 80\n"                  // a release writes both ports
+         "15 C 02\n");
+
+  // mode 1: one relay at a time, with 20 ms break-before-make
+  defaults();
+  CV.Mode = 1;
+  CV.RBreak = 20;
+  start();
+  command(1, 1); run(50);
+  command(2, 1); run(50);
+  command(2, 0); run(50);
+  expect("break-before-make",
+         "0 C 01\n"
+         "50 A 00\n"
+         "50 C 00\n"                  // relay 1 released at once,
+         "70 C 02\n"                  // relay 2 set 20 ms later
+         "100 A 00\n"
+         "100 C 00\n");
+
+  // inrush limit: at most 2 relays per 10 ms slice; the first commands are set at once
+  defaults();
+  CV.Mode = 2;
+  CV.RMaxOn = 2;
+  CV.RSlice = 10;
+  start();
+  command(1, 1); command(2, 1); command(3, 1); command(4, 1); command(5, 1);
+  run(50);
+  expect("inrush limit",
+         "0 C 01\n"
+         "0 C 03\n"
+         "10 C 0F\n"
+         "20 C 1F\n");
+
+  // a pause of 256 ms does not look like "just now": no stale slice or break
+  defaults();
+  CV.Mode = 2;
+  CV.RMaxOn = 1;
+  CV.RSlice = 10;
+  CV.RBreak = 20;
+  start();
+  command(1, 1); command(2, 1); run(246);
+  command(1, 0); run(10);
+  command(3, 1); command(4, 1); run(20);
+  expect("long pause",
+         "0 C 01\n"
+         "10 C 03\n"
+         "246 A 00\n"
+         "246 C 02\n"
+         "266 C 06\n"
+         "276 C 0E\n");
+
+  // pulse mode: relay 1 is released 50 ms after it was set
+  defaults();
+  CV.Mode = 2;
+  CV.RPulseL = 0x01;
+  CV.RPulse = 5;
+  start();
+  command(1, 1); command(2, 1); run(100);
+  expect("pulse",
+         "0 C 01\n"
+         "0 C 03\n"
+         "50 A 00\n"
+         "50 C 02\n");
+
+  // mode 0: setting a relay releases the others of its block; DEACTIVATE is ignored
+  defaults();
+  CV.Mode = 0;
+  start();
+  command(1, 1); run(5);
+  command(9, 1); run(5);
+  command(2, 1); run(5);
+  command(2, 0); run(5);
+  expect("mode 0",
+         "0 C 01\n"
+         "5 A 80\n"                  // relay 9: the other block keeps relay 1
+         "10 A 80\n"
+         "10 C 00\n"                  // relay 1 released,
+         "10 C 02\n");                // relay 2 set; DEACTIVATE changes nothing
+
+  // mode 3 (relays 1-8): round-robin over 3 relays, 50 ms each (CV535 = 5 x CV628 = 10 ms),
+  // relay 2 only 20 ms (CV613); commands to the block are ignored. Relays 9-16 in mode 2.
+  defaults();
+  CV.Mode = 2;
+  CV.ModeL = 3;
+  CV.RRR1 = 0x07;                // relays 1-3
+  CV.RInter = 5;
+  CV.RTick = 1;
+  CV.RDwell[1] = 2;
+  start();
+  run(100);
+  command(3, 1); command(9, 1); run(150);
+  expect("mode 3",
+         "1 C 01\n"
+         "50 A 00\n"
+         "50 C 00\n"
+         "50 C 02\n"                  // relay 2 after 50 ms,
+         "70 A 00\n"
+         "70 C 00\n"
+         "70 C 04\n"                  // relay 3 after 20 ms
+         "100 A 80\n"                 // relay 9 (mode 2); relay 3 ignored
+         "120 A 80\n"
+         "120 C 00\n"
+         "120 C 01\n"                 // relay 1 again after 50 ms
+         "170 A 80\n"
+         "170 C 00\n"
+         "170 C 02\n"
+         "190 A 80\n"
+         "190 C 00\n"
+         "190 C 04\n"
+         "240 A 80\n"
+         "240 C 00\n"
+         "240 C 01\n");
+
+  // a mutual-exclusion group over both blocks (relays 1, 2 and 9) in mode 2: setting relay 9
+  // releases relay 1, setting relay 2 then releases relay 9; relays 3 and 10 stay set
+  defaults();
+  CV.Mode = 2;
+  CV.RGroup[0].MaskL = 0x03;
+  CV.RGroup[0].MaskH = 0x01;
+  start();
+  command(1, 1); command(3, 1); command(10, 1); run(5);
+  command(9, 1); run(5);
+  command(2, 1); run(5);
+  expect("group",
+         "0 C 01\n"
+         "0 C 05\n"
+         "0 A 40\n"
+         "5 A 40\n"
+         "5 C 04\n"                   // relay 9 releases relay 1,
+         "5 A C0\n"
+         "10 A 40\n"
+         "10 C 04\n"                  // relay 2 releases relay 9
+         "10 C 06\n");
+
+  // per-block modes and a group of three in one block: relays 1-8 in mode 2 with the group
+  // relays 1-3, relays 9-16 in mode 1. Setting relay 2 releases relay 1 of its group, not
+  // relay 4 nor relay 9; setting relay 10 releases relay 9 of its block, not relays 2 and 4.
+  defaults();
+  CV.ModeL = 2;
+  CV.ModeH = 1;
+  CV.RGroup[0].MaskL = 0x07;
+  start();
+  command(1, 1); command(4, 1); command(9, 1); run(5);
+  command(2, 1); run(5);
+  command(10, 1); run(5);
+  expect("group in a block",
+         "0 C 01\n"
+         "0 C 09\n"
+         "0 A 80\n"
+         "5 A 80\n"
+         "5 C 08\n"                   // relay 1 released,
+         "5 C 0A\n"                   // relay 2 set
+         "10 A 00\n"
+         "10 C 0A\n"                  // relay 9 released,
+         "10 A 40\n");                // relay 10 set
+
+  // sequencer via an alias address: the command station repeats the packet; the repetitions
+  // do not restart the program (else relay 2 would follow 50 ms after the last repetition)
+  defaults();
+  CV.Mode = 2;
+  CV.RTick = 1;                  // 10 ms
+  CV.Alias[0].Op = ALIAS_SEQUENCE;
+  CV.Alias[0].MaskL = 0;         // program at offset 0:
+  memcpy(CV.Seq, "\x01\x01\x00\x05" "\x01\x02\x00\x05" "\x00", 9);   // 1, 50 ms, 2, 50 ms, end
+  start();
+  relays_alias(0, 1); run(20);
+  relays_alias(0, 1); run(20);
+  relays_alias(0, 1); run(100);
+  expect("alias sequence",
+         "1 C 01\n"                  // (the first pass of the main loop)
+         "50 A 00\n"
+         "50 C 00\n"                  // a step releases before it sets
+         "50 C 02\n");
+
+  // group switching via an alias address, with the packets repeated alternately with those of
+  // a command to our own address: neither repetition is executed again (relay 1 stays off)
+  defaults();
+  CV.Mode = 2;
+  CV.Alias[0].Op = ALIAS_EXCLUSIVE;
+  CV.Alias[0].MaskL = 0x02;      // relay 2
+  start();
+  command(1, 1); run(5);
+  relays_alias(0, 1); run(5);
+  command(1, 1); run(5);
+  relays_alias(0, 1); run(5);
+  command(1, 1); run(5);
+  expect("alias group",
+         "0 C 01\n"
+         "5 A 00\n"
+         "5 C 00\n"                  // relay 1 released,
+         "5 C 02\n");                 // relay 2 set
+
+  // switching cycles: relay 1 set 50 times per second for 70 minutes. A counter in RAM is
+  // halfway full after 11 minutes, but the flushes keep CNT_GAP (20 minutes) apart; the
+  // counter does not overflow meanwhile. After a power-up the totals of the last flush remain.
+  defaults();
+  CV.Mode = 2;
+  start();
+  flushes = 0;
+  for (i=0; i < 70UL * 60 * 50; i++) {
+    command(1, 1); flushes += run_counting(10);
+    command(1, 0); flushes += run_counting(10);
+  }
+  printf("switching cycles: %lu after 70 minutes, %u flushes\n", relays_cycles(0), flushes);
+  CHECK(flushes == 3);
+  CHECK(relays_cycles(0) == 210000UL);
+  CHECK(relays_cycles(1) == 0);
+  fclose(OutLog);
+  free(Log);
+  start();
+  CHECK(relays_cycles(0) == 180000UL);
+  fclose(OutLog);
+  OutLog = NULL;
+  free(Log);
+
+  return host_result("test_relays");
+}
@@ -0,0 +1,84 @@
+//------------------------------------------------------------------------
+//
+// file:      test/host/test_timers.c
+//
+// purpose:   Timer wheel of timer2.c: expiry times, also with a late main loop
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at http://www.gnu.org/licenses/gpl.txt
+//
+//------------------------------------------------------------------------
+//
+// The Timer2 ISR only marks the slots of the wheel; T2_TimerRun (main loop) calls the
+// handlers. If the main loop reacts at once, each handler runs exactly in the ms its timer
+// expires. If it is late, a handler runs at the first T2_TimerRun after that ms, never before,
+// also if a slot was passed several times meanwhile. A pulse timer has no handler, it sets its
+// bit in T2_PulseExpired.
+//
+//------------------------------------------------------------------------
+#include <stdio.h>
+#include <avr/pgmspace.h>
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+
+#include "config.h"
+#include "timer2.h"
+#include "host.h"
+
+static const unsigned int Delay[T2_TIMERS] =
+  {1, 2, 15, 16, 17, 31, 32, 33, 100, 255, 256, 257, 1000, 1001, 4095, 4096, 5000, 65535, 7};
+static unsigned long Expired[T2_TIMERS];
+
+static void handler(unsigned char id)
+{
+  Expired[id] = T2_Now();
+}
+
+static void pulses(void)
+{ // as relays_pulse: takes the pulse timers that expired
+  unsigned char i;
+  for (i=0; i < 16; i++) {
+    if (T2_PulseExpired & ((unsigned int)1 << i)) {Expired[T2_TIMER_PULSE + i] = T2_Now();}
+  }
+  T2_PulseExpired = 0;
+}
+
+static void test_run(unsigned int every)
+{ // T2_TimerRun every "every" ms; the timers are started in some slot of the wheel
+  unsigned char id;
+  unsigned long start, due, late;
+  init_timer2();
+  host_ms(every * 3 + 5);
+  start = T2_Now();
+  T2_PulseExpired = 0;
+  for (id=0; id < T2_TIMERS; id++) {
+    if (id < T2_TIMER_PULSE) {T2_TimerHandler(id, handler);}
+    T2_TimerStart(id, Delay[id]);
+    Expired[id] = 0;
+  }
+  while (T2_Now() < start + 66000UL) {
+    host_ms(every);
+    T2_TimerRun();
+    pulses();
+  }
+  for (id=0; id < T2_TIMERS; id++) {
+    due = start + Delay[id];
+    late = Expired[id] - due;
+    if (Expired[id] < due || late >= every) {
+      printf("every %u ms: timer %u (%u ms) expired at %lu, due %lu\n", every, id, Delay[id],
+             Expired[id], due);
+    }
+    CHECK(Expired[id] >= due);
+    CHECK(Expired[id] - due < every);
+  }
+}
+
+int main(void)
+{
+  test_run(1);                   // main loop at once: exact
+  test_run(5);
+  test_run(40);                  // slots passed more than once before T2_TimerRun
+  test_run(1000);
+  return host_result("test_timers");
+}
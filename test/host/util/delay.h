@@ -0,0 +1,25 @@
+//------------------------------------------------------------------------
+//
+// file:      test/host/util/delay.h
+//
+// purpose:   Stand-in for <util/delay.h>, to compile the decoder sources on a PC
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at http://www.gnu.org/licenses/gpl.txt
+//
+//------------------------------------------------------------------------
+//
+// Busy waiting takes no time on the PC; the tests advance the time with the Timer2 ISR.
+// A test can follow busy waiting with HostDelay (host.c), e.g. to let an input change.
+//
+//------------------------------------------------------------------------
+#ifndef _UTIL_DELAY_H_
+#define _UTIL_DELAY_H_
+
+extern void (*HostDelay)(unsigned int loops);   // called per busy wait (NULL: none)
+
+static inline void _delay_loop_2(unsigned int count) {if (HostDelay) {HostDelay(count);}}
+static inline void _delay_us(double us) {(void) us;}
+static inline void _delay_ms(double ms) {(void) ms;}
+
+#endif
@@ -0,0 +1,16 @@
+//------------------------------------------------------------------------
+//
+// file:      test/host/util/parity.h
+//
+// purpose:   Stand-in for <util/parity.h>, to compile the decoder sources on a PC
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at http://www.gnu.org/licenses/gpl.txt
+//
+//------------------------------------------------------------------------
+#ifndef _UTIL_PARITY_H_
+#define _UTIL_PARITY_H_
+
+#define parity_even_bit(val)  __builtin_parity((unsigned char) (val))
+
+#endif